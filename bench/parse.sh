@@ -0,0 +1,10 @@
+#!/bin/sh
+# Time the response extractors on every file of the corpus, saved bodies of
+# the quote, options and chart endpoints.
+# usage: [BIN=binary] bench/parse.sh [files]
+
+BIN=${BIN:-./myapp}
+[ $# -gt 0 ] || set -- bench/corpus/*.json
+for FILE in "$@"; do
+	"$BIN" --parse "$FILE"
+done
@@ -0,0 +1,32 @@
+#!/bin/sh
+# Render the list to terminals of several sizes behind pipes, for watchlists
+# of several lengths, while applying a synthetic stream of quotes in the
+# format of --headless, and report frames per second, bytes and CPU time per
+# frame. usage: [BIN=binary] bench/render.sh [quotes] [quotes per second]
+
+QUOTES=${1:-20000}
+RATE=${2:-200}
+BIN=${BIN:-./myapp}
+DIR=$(mktemp -d)
+
+trap 'rm -rf "$DIR"' EXIT INT TERM
+
+mkdir -p "$DIR/.config/tuimarket"
+for SYMBOLS in 50 500 5000; do
+	awk -v n="$SYMBOLS" 'BEGIN { for (i = 1; i <= n; i++) print "R" i }' \
+		> "$DIR/.config/tuimarket/symbols"
+	awk -v n="$SYMBOLS" -v q="$QUOTES" -v r="$RATE" 'BEGIN {
+		srand(1)
+		for (i = 1; i <= n; i++) price[i] = 100
+		for (k = 0; k < q; k++) {
+			i = int(rand() * n) + 1
+			price[i] *= 1 + (rand() - 0.5) / 50
+			printf "{\"time\":%.3f,\"symbol\":\"R%d\",\"price\":%.6g," \
+				"\"previous_close\":100,\"name\":\"Render %d\"}\n",
+				1700000000 + k / r, i, price[i], i
+		}
+	}' > "$DIR/quotes"
+	for SIZE in 80x24 160x50 320x100; do
+		HOME=$DIR "$BIN" --render "$DIR/quotes" --size "$SIZE"
+	done
+done
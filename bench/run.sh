@@ -0,0 +1,26 @@
+#!/bin/sh
+# Fetch the quotes of N synthetic symbols from a local stand-in of the quote
+# API for a few cycles and report throughput, CPU and phase latencies.
+# usage: [BIN=binary] bench/run.sh [symbols] [cycles] [port]
+
+SYMBOLS=${1:-1000}
+CYCLES=${2:-5}
+PORT=${3:-8765}
+BIN=${BIN:-./myapp}
+DIR=$(mktemp -d)
+
+trap 'kill $SERVER 2>/dev/null; rm -rf "$DIR"' EXIT INT TERM
+
+mkdir -p "$DIR/.config/tuimarket"
+i=1
+while [ $i -le "$SYMBOLS" ]; do
+	echo "B$i"
+	i=$((i + 1))
+done > "$DIR/.config/tuimarket/symbols"
+
+bench/server "$PORT" &
+SERVER=$!
+sleep 1
+
+echo "$SYMBOLS symbols, $CYCLES cycles"
+HOME=$DIR "$BIN" --server "http://127.0.0.1:$PORT" --bench "$CYCLES"
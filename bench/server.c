@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+/*
+ * HTTP/1.1 stand-in for the Yahoo Finance endpoints used by tuimarket,
+ * serving synthetic quotes with an option chain and one day charts, on
+ * 127.0.0.1:port until killed. usage: server port
+ */
+
+#define CONNECTIONS 1024
+#define STRIKES 20 /* calls and puts of each option chain */
+
+struct connection {
+	int fd;
+	char in[4096];
+	size_t in_length;
+	char *out;
+	size_t out_length, out_sent;
+};
+
+static struct connection connections[CONNECTIONS];
+static struct pollfd fds[CONNECTIONS + 1];
+static unsigned long seed = 1;
+
+static double random_unit() {
+	seed = (seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+	return seed / 2147483648.0;
+}
+
+/* append to a growing buffer */
+static void put(char **buf, size_t *length, size_t *capacity,
+		const char *fmt, ...) {
+
+	va_list ap;
+	int n;
+
+	for (;;) {
+		va_start(ap, fmt);
+		n = vsnprintf(*buf + *length, *capacity - *length, fmt, ap);
+		va_end(ap);
+		if (n >= 0 && (size_t)n < *capacity - *length) break;
+		*capacity *= 2;
+		*buf = realloc(*buf, *capacity);
+		if (!*buf) exit(1);
+	}
+	*length += n;
+}
+
+static void options(char **body, size_t *length, size_t *capacity,
+		const char *symbol) {
+
+	double price = 100 + random_unit() * 10;
+	int i;
+
+	put(body, length, capacity, "{\"optionChain\":{\"result\":[{"
+		"\"underlyingSymbol\":\"%s\",\"quote\":{\"symbol\":\"%s\","
+		"\"regularMarketPrice\":%.2f,\"regularMarketPreviousClose\":"
+		"102.0,\"regularMarketTime\":%ld,\"marketState\":\"REGULAR\","
+		"\"shortName\":\"Synthetic %s\"},\"options\":[{"
+		"\"expirationDate\":1700600000,\"calls\":[", symbol, symbol,
+		price, (long)time(NULL), symbol);
+	for (i = 0; i < 2 * STRIKES; i++) {
+		if (i == STRIKES) put(body, length, capacity, "],\"puts\":[");
+		put(body, length, capacity, "%s{\"contractSymbol\":\"%s%c%d\","
+			"\"strike\":%.1f,\"lastPrice\":%.2f,\"bid\":%.2f,"
+			"\"ask\":%.2f,\"impliedVolatility\":%.4f,"
+			"\"openInterest\":%d,\"inTheMoney\":%s}",
+			i % STRIKES ? "," : "", symbol, i < STRIKES ? 'C' : 'P',
+			i % STRIKES, 80 + (i % STRIKES) * 2.5,
+			random_unit() * 10, random_unit() * 10,
+			random_unit() * 10 + 0.1, random_unit(),
+			(int)(random_unit() * 1000),
+			random_unit() < 0.5 ? "true" : "false");
+	}
+	put(body, length, capacity, "]}]}],\"error\":null}}");
+}
+
+static void chart(char **body, size_t *length, size_t *capacity) {
+
+	double close = 100;
+	int i, n = 390;
+
+	put(body, length, capacity, "{\"chart\":{\"result\":[{\"meta\":{},"
+		"\"timestamp\":[");
+	for (i = 0; i < n; i++)
+		put(body, length, capacity, "%s%d", i ? "," : "",
+			1700000000 + 60 * i);
+	put(body, length, capacity, "],\"indicators\":{\"quote\":[{\"close\":[");
+	for (i = 0; i < n; i++) {
+		close += random_unit() - 0.5;
+		put(body, length, capacity, "%s%.2f", i ? "," : "", close);
+	}
+	put(body, length, capacity, "]}]}}],\"error\":null}}");
+}
+
+/* build the response to the request line in c->in */
+static void respond(struct connection *c) {
+
+	char path[1024], *body, *symbol;
+	size_t length = 0, capacity = 8192, head = 0, head_capacity = 256;
+	int status = 200;
+
+	body = malloc(capacity);
+	if (!body) exit(1);
+	/* only GET is served, anything else is answered and skipped */
+	if (sscanf(c->in, "GET %1023s", path) != 1) status = 405;
+	else if (!(symbol = strrchr(path, '/'))) status = 404;
+	else {
+		symbol++;
+		if (strchr(symbol, '?')) *strchr(symbol, '?') = '\0';
+		if (strstr(path, "/v7/finance/options/"))
+			options(&body, &length, &capacity, symbol);
+		else if (strstr(path, "/v8/finance/chart/"))
+			chart(&body, &length, &capacity);
+		else status = 404;
+	}
+
+	c->out = malloc(head_capacity);
+	if (!c->out) exit(1);
+	put(&c->out, &head, &head_capacity, "HTTP/1.1 %d %s\r\n"
+		"Content-Type: application/json\r\nContent-Length: %lu\r\n%s"
+		"\r\n", status, status == 200 ? "OK" : status == 405 ?
+		"Method Not Allowed" : "Not Found", (unsigned long)length,
+		status == 405 ? "Allow: GET\r\n" : "");
+	c->out = realloc(c->out, head + length);
+	if (!c->out) exit(1);
+	memcpy(c->out + head, body, length);
+	free(body);
+	c->out_length = head + length;
+	c->out_sent = 0;
+}
+
+static void closed(struct connection *c) {
+	close(c->fd);
+	free(c->out);
+	c->out = NULL;
+	c->fd = -1;
+}
+
+/* answer the next complete request received, if any */
+static void next_request(struct connection *c) {
+
+	char *end;
+
+	end = strstr(c->in, "\r\n\r\n");
+	if (!end) return;
+	respond(c);
+	c->in_length -= end + 4 - c->in;
+	memmove(c->in, end + 4, c->in_length + 1);
+}
+
+static void readable(struct connection *c) {
+
+	ssize_t len;
+
+	len = read(c->fd, c->in + c->in_length,
+		sizeof(c->in) - c->in_length - 1);
+	if (len <= 0) {
+		if (len == -1 && errno == EAGAIN) return;
+		closed(c);
+		return;
+	}
+	c->in_length += len;
+	c->in[c->in_length] = '\0';
+	next_request(c);
+	if (!c->out && c->in_length == sizeof(c->in) - 1) closed(c);
+}
+
+static void writable(struct connection *c) {
+
+	ssize_t len;
+
+	len = write(c->fd, c->out + c->out_sent, c->out_length - c->out_sent);
+	if (len == -1 && errno == EAGAIN) return;
+	if (len <= 0) {
+		closed(c);
+		return;
+	}
+	c->out_sent += len;
+	if (c->out_sent < c->out_length) return;
+	free(c->out);
+	c->out = NULL;
+	next_request(c);
+}
+
+int main(int argc, char *argv[]) {
+
+	struct sockaddr_in addr;
+	struct connection *c;
+	int listen_fd, fd, one = 1, i, n;
+
+	if (argc != 2) {
+		printf("usage: %s port\n", argv[0]);
+		return 1;
+	}
+	signal(SIGPIPE, SIG_IGN);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(atoi(argv[1]));
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (listen_fd == -1 || bind(listen_fd, (struct sockaddr*)&addr,
+			sizeof(addr)) || listen(listen_fd, CONNECTIONS)) {
+		perror("server");
+		return 1;
+	}
+	for (i = 0; i < CONNECTIONS; i++) connections[i].fd = -1;
+
+	for (;;) {
+		fds[0].fd = listen_fd;
+		fds[0].events = POLLIN;
+		for (i = 0; i < CONNECTIONS; i++) {
+			c = &connections[i];
+			fds[i + 1].fd = c->fd;
+			fds[i + 1].events = c->out ? POLLOUT : POLLIN;
+		}
+		n = poll(fds, CONNECTIONS + 1, -1);
+		if (n <= 0) continue;
+
+		if (fds[0].revents) {
+			fd = accept(listen_fd, NULL, NULL);
+			for (i = 0; fd != -1 && i < CONNECTIONS; i++)
+				if (connections[i].fd == -1) break;
+			if (fd != -1 && i == CONNECTIONS) close(fd);
+			else if (fd != -1) {
+				fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+				connections[i].fd = fd;
+				connections[i].in_length = 0;
+				connections[i].in[0] = '\0';
+			}
+		}
+		for (i = 0; i < CONNECTIONS; i++) {
+			c = &connections[i];
+			if (c->fd == -1 || !fds[i + 1].revents) continue;
+			if (c->out) writable(c);
+			else readable(c);
+		}
+	}
+}
@@ -0,0 +1,256 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include "termbox.h"
+#include "strlcpy.h"
+#include "symbol.h"
+#include "history.h"
+#include "alerts.h"
+
+#define RULE_ABOVE 0
+#define RULE_BELOW 1
+#define RULE_CHANGE 2
+#define RULE_MOVE 3
+
+static const char *rule_names[] = { "above", "below", "change", "move" };
+
+struct rule {
+	size_t symbol;
+	int type;
+	float value;
+	unsigned int minutes; /* window of a move */
+	int active; /* condition true on the last quote, fires on rising edge */
+};
+
+/* rules sorted by symbol, those of symbol i start at rules[first[i]] */
+static struct rule *rules = NULL;
+static size_t rules_length = 0, *first = NULL;
+
+/* notification sinks */
+static int bell = 0;
+static FILE *log_file = NULL;
+static char command[1024];
+
+/* rows to highlight and bells to ring, set by the fetcher */
+static pthread_mutex_t alerts_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned char *alerted = NULL;
+static int ring = 0;
+
+static int compare_rule(const void *a, const void *b) {
+
+	size_t sa = ((const struct rule*)a)->symbol;
+	size_t sb = ((const struct rule*)b)->symbol;
+
+	return (sa > sb) - (sa < sb);
+}
+
+/* parse a rule line, -1 if malformed or the symbol is not watched */
+static int parse_rule(char *line, struct rule *rule) {
+
+	char symbol[16], type[16];
+	long found;
+	int i, n;
+
+	memset(rule, 0, sizeof(*rule));
+	n = sscanf(line, "%15s %15s %f %u", symbol, type, &rule->value,
+		&rule->minutes);
+	if (n < 3) return -1;
+
+	for (i = 0; i < (int)(sizeof(rule_names) / sizeof(*rule_names)); i++)
+		if (!strcmp(type, rule_names[i])) break;
+	if (i == sizeof(rule_names) / sizeof(*rule_names)) return -1;
+	if (i == RULE_MOVE && (n < 4 || !rule->minutes)) return -1;
+	rule->type = i;
+
+	found = symbol_find(symbol);
+	if (found == -1) return -1;
+	rule->symbol = found;
+	return 0;
+}
+
+/*
+ * Load the rules and sinks of the alerts file, one per line:
+ *   SYMBOL above PRICE, SYMBOL below PRICE
+ *   SYMBOL change PERCENT (day change in either direction)
+ *   SYMBOL move PERCENT MINUTES
+ *   bell, log FILE, run COMMAND (given symbol, price and rule as $1 to $3)
+ */
+int alerts_load(const char *path) {
+
+	FILE *f;
+	char line[1024];
+	struct rule rule, *p;
+	size_t i, len;
+	int ret = 0, number = 0;
+
+	alerted = calloc(symbols_length, 1);
+	first = calloc(symbols_length + 1, sizeof(*first));
+	if (symbols_length && (!alerted || !first)) return -1;
+
+	f = fopen(path, "r");
+	if (!f) return 0;
+
+	while (fgets(line, sizeof(line), f)) {
+		number++;
+		len = strlen(line);
+		if (len && line[len - 1] == '\n') line[--len] = '\0';
+		if (!len || line[0] == '#') continue;
+
+		if (!strcmp(line, "bell")) {
+			bell = 1;
+		} else if (!strncmp(line, "log ", 4)) {
+			if (log_file) fclose(log_file);
+			log_file = fopen(line + 4, "a");
+			if (!log_file)
+				fprintf(stderr, "cannot open %s\n", line + 4);
+		} else if (!strncmp(line, "run ", 4)) {
+			strlcpy(command, line + 4, sizeof(command));
+		} else if (parse_rule(line, &rule)) {
+			fprintf(stderr, "%s:%d: ignored rule\n", path, number);
+		} else {
+			p = realloc(rules, (rules_length + 1) * sizeof(*rules));
+			if (!p) {
+				ret = -1;
+				break;
+			}
+			rules = p;
+			rules[rules_length++] = rule;
+		}
+	}
+	fclose(f);
+
+	qsort(rules, rules_length, sizeof(*rules), compare_rule);
+	for (i = 0; i < rules_length; i++) first[rules[i].symbol + 1]++;
+	for (i = 0; i < symbols_length; i++) first[i + 1] += first[i];
+	return ret;
+}
+
+void alerts_free() {
+	if (log_file) fclose(log_file);
+	free(rules);
+	free(first);
+	free(alerted);
+}
+
+/* run the alert command without waiting for it */
+static void run_command(const char *symbol, const char *price,
+		const char *rule) {
+
+	sigset_t empty;
+	pid_t pid;
+
+	pid = fork();
+	if (pid == -1) return;
+	if (!pid) {
+		if (fork()) _exit(0);
+		/* headless and daemon modes block SIGINT and SIGTERM */
+		sigemptyset(&empty);
+		sigprocmask(SIG_SETMASK, &empty, NULL);
+		signal(SIGPIPE, SIG_DFL); /* ignored by --listen */
+		execl("/bin/sh", "sh", "-c", command, "sh", symbol, price, rule,
+			(char*)NULL);
+		_exit(127);
+	}
+	waitpid(pid, NULL, 0);
+}
+
+static void notify(const struct symbol *s, const struct rule *rule) {
+
+	char price[32], text[64], date[32];
+	struct tm tm;
+	time_t t;
+
+	snprintf(price, sizeof(price), "%.2f", s->price);
+	if (rule->type == RULE_MOVE)
+		snprintf(text, sizeof(text), "move %g %u", rule->value,
+			rule->minutes);
+	else snprintf(text, sizeof(text), "%s %g", rule_names[rule->type],
+			rule->value);
+
+	if (log_file) {
+		t = time(NULL);
+		strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S",
+			localtime_r(&t, &tm));
+		fprintf(log_file, "%s %s %s at %s\n", date, s->symbol, text,
+			price);
+		fflush(log_file);
+	}
+	if (*command) run_command(s->symbol, price, text);
+}
+
+static int holds(const struct symbol *s, const struct rule *rule) {
+
+	float change;
+
+	switch (rule->type) {
+	case RULE_ABOVE:
+		return s->price >= rule->value;
+	case RULE_BELOW:
+		return s->price <= rule->value;
+	case RULE_CHANGE:
+		if (!s->previous_price) return 0;
+		change = s->price / s->previous_price * 100 - 100;
+		return change >= rule->value || change <= -rule->value;
+	case RULE_MOVE:
+		if (history_change(s->history, rule->minutes * 60, &change))
+			return 0;
+		return change >= rule->value || change <= -rule->value;
+	}
+	return 0;
+}
+
+/* evaluate the rules of symbol i after its quote, from the fetcher thread */
+void alerts_check(size_t i) {
+
+	struct rule *rule;
+	size_t k;
+	int active = 0, fired = 0;
+
+	if (!rules_length) return;
+	for (k = first[i]; k < first[i + 1]; k++) {
+		rule = &rules[k];
+		if (holds(&symbols[i], rule)) {
+			if (!rule->active) {
+				notify(&symbols[i], rule);
+				fired = 1;
+			}
+			rule->active = 1;
+			active = 1;
+		} else rule->active = 0;
+	}
+
+	pthread_mutex_lock(&alerts_lock);
+	alerted[i] = active;
+	if (fired && bell) ring = 1;
+	pthread_mutex_unlock(&alerts_lock);
+}
+
+/* whether a rule of symbol i holds, from the UI thread */
+int alerts_active(size_t i) {
+
+	int ret;
+
+	if (!rules_length) return 0;
+	pthread_mutex_lock(&alerts_lock);
+	ret = alerted[i];
+	pthread_mutex_unlock(&alerts_lock);
+	return ret;
+}
+
+/* ring the terminal bell for the alerts fired since the last call */
+void alerts_ring() {
+
+	int r;
+
+	pthread_mutex_lock(&alerts_lock);
+	r = ring;
+	ring = 0;
+	pthread_mutex_unlock(&alerts_lock);
+	if (r) tb_send("\a", 1);
+}
@@ -0,0 +1,5 @@
+int alerts_load(const char *path);
+void alerts_free(void);
+void alerts_check(size_t i);
+int alerts_active(size_t i);
+void alerts_ring(void);
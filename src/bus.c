@@ -0,0 +1,264 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "strlcpy.h"
+#include "symbol.h"
+#include "bus.h"
+
+#ifdef __GNUC__
+#define barrier() __sync_synchronize()
+#else
+#define barrier()
+#endif
+
+#define BUS_MAGIC "tuimarket bus 2"
+#define BUS_RETRIES 1000 /* reads of a row before giving up on the daemon */
+
+/*
+ * Shared memory segment written by a --daemon process and read by the
+ * others. Each row is guarded by a sequence lock: the writer makes its
+ * sequence odd while writing, a reader retries until it copied the row
+ * between two reads of the same even sequence. published counts every
+ * row written, so readers skip the scan while nothing changed.
+ */
+struct bus_header {
+	char magic[16];
+	uint32_t row_size;
+	uint32_t length;
+	int32_t pid; /* of the daemon */
+	volatile uint32_t published;
+};
+
+struct bus_row {
+	volatile uint32_t sequence;
+	uint32_t time; /* of the quote, seconds since the epoch */
+	uint32_t market_time; /* exchange time of the quote */
+	int32_t regular;
+	char symbol[16];
+	char name[256];
+	float price;
+	float previous_price;
+};
+
+static struct bus_header *bus = NULL;
+static struct bus_row *rows = NULL;
+static size_t bus_size = 0;
+static int publisher = 0;
+
+/* reader state: bus row of each symbol, sequence last copied from it */
+static long *row_of = NULL;
+static uint32_t *seen = NULL, published = 0;
+
+/* name of the segment, shared by the daemon and its readers */
+static char bus_path[64] = "/tuimarket";
+
+/* use the segment /name instead of /tuimarket, -1 if name is invalid */
+int bus_name(const char *name) {
+
+	if (*name == '/') name++;
+	if (!*name || strchr(name, '/') ||
+			strlen(name) + 1 >= sizeof(bus_path)) {
+		errno = EINVAL;
+		return -1;
+	}
+	bus_path[0] = '/';
+	strlcpy(bus_path + 1, name, sizeof(bus_path) - 1);
+	return 0;
+}
+
+/* create the segment and publish the symbols of this process */
+int bus_create() {
+
+	size_t i;
+	int fd;
+
+	if (!bus_attach()) {
+		bus_close();
+		errno = EEXIST;
+		return -1;
+	}
+
+	/* viewers of a previous daemon keep their mapping until they detach */
+	shm_unlink(bus_path);
+	bus_size = sizeof(*bus) + symbols_length * sizeof(*rows);
+	/* readable by the group, so that its users share one daemon */
+	fd = shm_open(bus_path, O_RDWR | O_CREAT | O_EXCL, 0640);
+	if (fd == -1) return -1;
+	if (ftruncate(fd, bus_size)) {
+		close(fd);
+		return -1;
+	}
+	bus = mmap(NULL, bus_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (bus == MAP_FAILED) {
+		bus = NULL;
+		return -1;
+	}
+
+	rows = (struct bus_row*)(bus + 1);
+	for (i = 0; i < symbols_length; i++)
+		strlcpy(rows[i].symbol, symbols[i].symbol,
+			sizeof(rows[i].symbol));
+	bus->row_size = sizeof(*rows);
+	bus->length = symbols_length;
+	bus->pid = getpid();
+	barrier();
+	memcpy(bus->magic, BUS_MAGIC, sizeof(BUS_MAGIC));
+	publisher = 1;
+	return 0;
+}
+
+static int daemon_alive() {
+
+	pid_t pid = bus->pid;
+
+	/* 0 or -1 would signal a whole group */
+	return pid > 0 && (!kill(pid, 0) || errno == EPERM);
+}
+
+/* map the segment of a running daemon read only, -1 if there is none */
+int bus_attach() {
+
+	struct stat st;
+	char symbol[sizeof(rows->symbol) + 1];
+	size_t i;
+	long found;
+	int fd;
+
+	fd = shm_open(bus_path, O_RDONLY, 0);
+	if (fd == -1) return -1;
+	if (fstat(fd, &st) || (size_t)st.st_size < sizeof(*bus)) {
+		close(fd);
+		return -1;
+	}
+	bus_size = st.st_size;
+	bus = mmap(NULL, bus_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (bus == MAP_FAILED) {
+		bus = NULL;
+		return -1;
+	}
+
+	if (memcmp(bus->magic, BUS_MAGIC, sizeof(BUS_MAGIC)) ||
+			bus->row_size != sizeof(*rows) ||
+			sizeof(*bus) + bus->length * sizeof(*rows) > bus_size ||
+			!daemon_alive()) {
+		bus_close();
+		return -1;
+	}
+	rows = (struct bus_row*)(bus + 1);
+
+	row_of = malloc(symbols_length * sizeof(*row_of));
+	seen = calloc(symbols_length, sizeof(*seen));
+	if (symbols_length && (!row_of || !seen)) {
+		bus_close();
+		return -1;
+	}
+	for (i = 0; i < symbols_length; i++) row_of[i] = -1;
+	/* the segment may be written by another user, nothing is trusted */
+	for (i = 0; i < bus->length; i++) {
+		memcpy(symbol, rows[i].symbol, sizeof(symbol) - 1);
+		symbol[sizeof(symbol) - 1] = '\0';
+		found = symbol_find(symbol);
+		if (found != -1) row_of[found] = i;
+	}
+	return 0;
+}
+
+void bus_close() {
+	if (publisher) shm_unlink(bus_path);
+	if (bus) munmap(bus, bus_size);
+	bus = NULL;
+	publisher = 0;
+	free(row_of);
+	free(seen);
+	row_of = NULL;
+	seen = NULL;
+}
+
+/* write the quote of symbol i to its row, from the daemon fetcher thread */
+void bus_publish(size_t i, uint32_t time) {
+
+	struct bus_row *row;
+
+	if (!publisher) return;
+	row = &rows[i];
+	row->sequence++;
+	barrier();
+	row->time = time;
+	row->price = symbols[i].price;
+	row->previous_price = symbols[i].previous_price;
+	row->market_time = symbols[i].market_time;
+	row->regular = symbols[i].regular;
+	strlcpy(row->name, symbols[i].name, sizeof(row->name));
+	barrier();
+	row->sequence++;
+	bus->published++;
+}
+
+int bus_attached() {
+	return row_of != NULL;
+}
+
+/* whether symbol i is quoted by the daemon instead of being fetched */
+int bus_backed(size_t i) {
+	return row_of && row_of[i] != -1;
+}
+
+/*
+ * Copy the rows written since the last call into their symbols and call cb
+ * for each, from the fetcher thread. Stops reading once the daemon exited,
+ * or a row stays mid write (the daemon died in bus_publish), its symbols
+ * are then fetched again by this process.
+ */
+void bus_poll(bus_cb cb) {
+
+	struct bus_row row;
+	uint32_t now, sequence;
+	size_t i;
+	int tries;
+
+	if (!row_of) return;
+	if (!daemon_alive()) {
+		bus_close();
+		return;
+	}
+	now = bus->published;
+	if (now == published) return;
+	published = now;
+	barrier();
+
+	for (i = 0; i < symbols_length; i++) {
+		if (row_of[i] == -1) continue;
+		tries = 0;
+		do {
+			if (tries++ == BUS_RETRIES) {
+				bus_close();
+				return;
+			}
+			sequence = rows[row_of[i]].sequence;
+			barrier();
+			memcpy(&row, (const void*)&rows[row_of[i]], sizeof(row));
+			barrier();
+		} while ((sequence & 1) ||
+			sequence != rows[row_of[i]].sequence);
+		if (sequence == seen[i]) continue;
+		seen[i] = sequence;
+
+		symbols[i].price = row.price;
+		symbols[i].previous_price = row.previous_price;
+		symbols[i].market_time = row.market_time;
+		symbols[i].regular = row.regular;
+		row.name[sizeof(row.name) - 1] = '\0';
+		strlcpy(symbols[i].name, row.name, sizeof(symbols[i].name));
+		cb(i, row.time);
+	}
+}
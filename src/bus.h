@@ -0,0 +1,9 @@
+typedef void (*bus_cb)(size_t i, uint32_t time);
+int bus_name(const char *name);
+int bus_create(void);
+int bus_attach(void);
+void bus_close(void);
+void bus_publish(size_t i, uint32_t time);
+int bus_attached(void);
+int bus_backed(size_t i);
+void bus_poll(bus_cb cb);
@@ -0,0 +1,371 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <math.h>
+#include "termbox.h"
+#include "history.h"
+#include "chart.h"
+#include "strnstr.h"
+#include "config.h"
+
+#define BLOCK 0x2581 /* lower one eighth block, the 7 next are taller */
+#define AXIS 10 /* width of the price axis */
+#define SIZEOF(X) (sizeof(X) / sizeof(*X))
+
+/* candles of span seconds, merged in place as ticks arrive */
+struct series {
+	uint32_t span;
+	size_t length;
+	struct candle candles[CANDLES];
+};
+
+static const uint32_t spans[] = {
+	60, 120, 300, 600, 900, 1800, 3600, 7200, 14400, 28800, 86400
+};
+
+/* bars of the chart endpoint, written by the fetcher */
+static pthread_mutex_t chart_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct candle chart_bars[CANDLES];
+static size_t chart_bars_length = 0;
+static unsigned int chart_version = 0;
+
+/* state of the chart view, only used from the UI thread */
+static struct series series;
+static unsigned int series_version = -1;
+static uint32_t series_tick = 0;
+static int series_width = 0, zoom = 0, zoom_auto = 1;
+
+/*
+ * Reduce length ticks to at most width prices with the largest triangle
+ * three buckets algorithm, keeping the first and the last tick.
+ */
+size_t downsample(const struct tick *ticks, size_t length, float *out,
+			size_t width) {
+
+	size_t i, j, a, start, end, next_end;
+	double bucket, avg_x, avg_y, area, best;
+
+	if (length <= width || width < 3) {
+		start = length > width ? length - width : 0;
+		for (i = start; i < length; i++) out[i - start] = ticks[i].price;
+		return length - start;
+	}
+
+	bucket = (double)(length - 2) / (width - 2);
+	out[0] = ticks[0].price;
+	a = 0;
+	for (i = 0; i < width - 2; i++) {
+		start = (size_t)(i * bucket) + 1;
+		end = (size_t)((i + 1) * bucket) + 1;
+		next_end = (size_t)((i + 2) * bucket) + 1;
+		if (next_end > length) next_end = length;
+
+		/* average of the next bucket, the last tick for the last one */
+		avg_x = avg_y = 0;
+		for (j = end; j < next_end; j++) {
+			avg_x += ticks[j].time;
+			avg_y += ticks[j].price;
+		}
+		if (next_end > end) {
+			avg_x /= next_end - end;
+			avg_y /= next_end - end;
+		} else {
+			avg_x = ticks[length - 1].time;
+			avg_y = ticks[length - 1].price;
+		}
+
+		best = -1;
+		for (j = start; j < end; j++) {
+			area = fabs(((double)ticks[a].time - avg_x) *
+				(ticks[j].price - ticks[a].price) -
+				((double)ticks[a].time - ticks[j].time) *
+				(avg_y - ticks[a].price));
+			if (area > best) {
+				best = area;
+				out[i + 1] = ticks[j].price;
+				a = j;
+			}
+		}
+	}
+	out[width - 1] = ticks[length - 1].price;
+	return width;
+}
+
+/* draw the price history of a symbol with block glyphs, right aligned */
+void draw_sparkline(int x, int y, int width, struct history *h,
+			uintattr_t fg) {
+
+	struct tick ticks[HISTORY];
+	float prices[HISTORY], low, high;
+	size_t length, i;
+	int level;
+
+	if (width <= 0) return;
+	if (width > HISTORY) width = HISTORY;
+
+	length = history_read(h, ticks, HISTORY);
+	length = downsample(ticks, length, prices, width);
+	if (!length) return;
+
+	low = high = prices[0];
+	for (i = 1; i < length; i++) {
+		if (prices[i] < low) low = prices[i];
+		if (prices[i] > high) high = prices[i];
+	}
+
+	x += width - length;
+	for (i = 0; i < length; i++) {
+		level = high > low ? (prices[i] - low) / (high - low) * 7.99 : 0;
+		tb_set_cell(x + i, y, BLOCK + level, fg, TB_DEFAULT);
+	}
+}
+
+static void series_reset(struct series *s, uint32_t span) {
+	s->span = span;
+	s->length = 0;
+}
+
+/* merge c into the last candle of its bucket or start a new one */
+static void series_add(struct series *s, const struct candle *c) {
+
+	struct candle *last;
+	uint32_t bucket;
+
+	bucket = c->time - c->time % s->span;
+	last = s->length ? &s->candles[s->length - 1] : NULL;
+
+	if (last && last->time == bucket) {
+		if (c->high > last->high) last->high = c->high;
+		if (c->low < last->low) last->low = c->low;
+		last->close = c->close;
+		return;
+	}
+	if (last && last->time > bucket) return;
+
+	if (s->length == CANDLES) {
+		memmove(s->candles, s->candles + CANDLES / 4,
+			(CANDLES - CANDLES / 4) * sizeof(*s->candles));
+		s->length -= CANDLES / 4;
+	}
+	s->candles[s->length] = *c;
+	s->candles[s->length].time = bucket;
+	s->length++;
+}
+
+/* add the ticks more recent than the last one added */
+static void series_ticks(struct series *s, struct history *h) {
+
+	struct tick ticks[HISTORY];
+	struct candle c;
+	size_t length, i;
+
+	length = history_read(h, ticks, HISTORY);
+	for (i = 0; i < length; i++) {
+		if (ticks[i].time <= series_tick) continue;
+		c.time = series_tick = ticks[i].time;
+		c.open = c.high = c.low = c.close = ticks[i].price;
+		series_add(s, &c);
+	}
+}
+
+void chart_reset() {
+	pthread_mutex_lock(&chart_lock);
+	chart_bars_length = 0;
+	chart_version++;
+	pthread_mutex_unlock(&chart_lock);
+	zoom_auto = 1;
+}
+
+/* parse the numbers of the JSON array following key, null gives -1 */
+static size_t parse_array(const char *data, size_t len, const char *key,
+			double *out, size_t max) {
+
+	const char *p, *end = data + len;
+	char *next;
+	size_t i = 0;
+
+	p = strnstr(data, key, len);
+	if (!p) return 0;
+	p += strlen(key);
+
+	while (p < end && *p != ']' && i < max) {
+		while (p < end && (*p == ',' || *p == ' ')) p++;
+		if (p >= end || *p == ']') break;
+		if (!strncmp(p, "null", 4)) {
+			out[i++] = -1;
+			p += 4;
+			continue;
+		}
+		out[i] = strtod(p, &next);
+		if (next == p) break;
+		p = next;
+		i++;
+	}
+	return i;
+}
+
+/* load the bars of a v8/finance/chart response, called by the fetcher */
+int chart_parse(const char *data, size_t len) {
+
+	const char *keys[] = {
+		"\"timestamp\":[", "\"open\":[", "\"high\":[", "\"low\":[",
+		"\"close\":["
+	};
+	double *values[SIZEOF(keys)];
+	size_t i, j, length;
+	int ret = -1;
+
+	memset(values, 0, sizeof(values));
+	for (i = 0; i < SIZEOF(keys); i++) {
+		values[i] = malloc(CANDLES * sizeof(double));
+		if (!values[i]) goto clean;
+	}
+
+	length = parse_array(data, len, keys[0], values[0], CANDLES);
+	for (i = 1; i < SIZEOF(keys); i++)
+		if (parse_array(data, len, keys[i], values[i], CANDLES) <
+				length)
+			goto clean;
+
+	pthread_mutex_lock(&chart_lock);
+	chart_bars_length = 0;
+	for (j = 0; j < length; j++) {
+		struct candle *c = &chart_bars[chart_bars_length];
+		if (values[1][j] < 0 || values[2][j] < 0 ||
+				values[3][j] < 0 || values[4][j] < 0)
+			continue;
+		c->time = values[0][j];
+		c->open = values[1][j];
+		c->high = values[2][j];
+		c->low = values[3][j];
+		c->close = values[4][j];
+		chart_bars_length++;
+	}
+	chart_version++;
+	pthread_mutex_unlock(&chart_lock);
+	ret = 0;
+clean:
+	for (i = 0; i < SIZEOF(keys); i++) free(values[i]);
+	return ret;
+}
+
+void chart_zoom(int delta) {
+	zoom_auto = 0;
+	zoom += delta;
+	if (zoom < 0) zoom = 0;
+	if (zoom >= (int)SIZEOF(spans)) zoom = SIZEOF(spans) - 1;
+}
+
+/* rebuild the series with the bars of the endpoint then the ticks */
+static void series_build(struct series *s, struct history *h, int width) {
+
+	struct tick ticks[HISTORY];
+	size_t i, length;
+	uint32_t first, last;
+
+	pthread_mutex_lock(&chart_lock);
+
+	/* pick the smallest span fitting the data in the width */
+	if (zoom_auto) {
+		length = history_read(h, ticks, HISTORY);
+		first = chart_bars_length ? chart_bars[0].time :
+			length ? ticks[0].time : 0;
+		last = length ? ticks[length - 1].time :
+			chart_bars_length ?
+			chart_bars[chart_bars_length - 1].time : 0;
+		for (zoom = 0; zoom < (int)SIZEOF(spans) - 1; zoom++)
+			if ((last - first) / spans[zoom] < (uint32_t)width)
+				break;
+	}
+
+	series_reset(s, spans[zoom]);
+	series_tick = 0;
+	for (i = 0; i < chart_bars_length; i++) {
+		series_add(s, &chart_bars[i]);
+		series_tick = chart_bars[i].time + 59;
+	}
+	series_version = chart_version;
+	pthread_mutex_unlock(&chart_lock);
+
+	series_ticks(s, h);
+	series_width = width;
+}
+
+static int price_row(float price, float low, float high, int top, int rows) {
+	if (high <= low) return top + rows / 2;
+	return top + (int)((high - price) / (high - low) * (rows - 1) + 0.5);
+}
+
+/* draw the candles of a symbol over the whole screen */
+void draw_chart(const char *symbol, const char *name, struct history *h) {
+
+	const struct candle *c;
+	unsigned int version;
+	size_t first, i;
+	float low, high;
+	int w, h_, x, y, top, rows, width, gain;
+
+	w = tb_width();
+	h_ = tb_height();
+	width = w - AXIS - 1;
+	top = 2;
+	rows = h_ - top - 1;
+	if (width < 2 || rows < 2) return;
+
+	pthread_mutex_lock(&chart_lock);
+	version = chart_version;
+	pthread_mutex_unlock(&chart_lock);
+
+	if (series_version != version || series_width != width ||
+			series.span != spans[zoom])
+		series_build(&series, h, width);
+	else
+		series_ticks(&series, h);
+
+	for (x = 0; x < w; x++) tb_set_cell(x, 0, ' ', TB_BLACK, TB_WHITE);
+	tb_printf(0, 0, TB_BLACK, TB_WHITE, " %s | %s | %u min candles",
+		symbol, name, series.span / 60);
+	tb_print(w - sizeof("+/- zoom, esc back"), 0, TB_BLACK, TB_WHITE,
+		"+/- zoom, esc back");
+
+	if (!series.length) {
+		tb_print(1, top, TB_DEFAULT, TB_DEFAULT, "loading...");
+		return;
+	}
+
+	first = series.length > (size_t)width ? series.length - width : 0;
+	low = series.candles[first].low;
+	high = series.candles[first].high;
+	for (i = first; i < series.length; i++) {
+		if (series.candles[i].low < low) low = series.candles[i].low;
+		if (series.candles[i].high > high) high = series.candles[i].high;
+	}
+
+	for (i = first; i < series.length; i++) {
+		int body_top, body_bottom, wick_top, wick_bottom;
+		c = &series.candles[i];
+		x = i - first;
+		gain = c->close >= c->open;
+		wick_top = price_row(c->high, low, high, top, rows);
+		wick_bottom = price_row(c->low, low, high, top, rows);
+		body_top = price_row(gain ? c->close : c->open,
+			low, high, top, rows);
+		body_bottom = price_row(gain ? c->open : c->close,
+			low, high, top, rows);
+		for (y = wick_top; y <= wick_bottom; y++)
+			tb_set_cell(x, y, y >= body_top && y <= body_bottom ?
+				0x2588 : 0x2502, gain ? TB_GREEN : TB_RED,
+				TB_DEFAULT);
+	}
+
+	for (y = top; y < top + rows; y++)
+		tb_set_cell(width, y, 0x2502, TB_DEFAULT, TB_DEFAULT);
+	tb_printf(width + 1, top, TB_DEFAULT, TB_DEFAULT, "%.2f", high);
+	tb_printf(width + 1, top + rows - 1, TB_DEFAULT, TB_DEFAULT, "%.2f",
+		low);
+	c = &series.candles[series.length - 1];
+	y = price_row(c->close, low, high, top, rows);
+	if (y != top && y != top + rows - 1)
+		tb_printf(width + 1, y, TB_BLACK, TB_WHITE, "%.2f", c->close);
+}
@@ -0,0 +1,12 @@
+struct candle {
+	uint32_t time; /* start of the bucket */
+	float open, high, low, close;
+};
+size_t downsample(const struct tick *ticks, size_t length, float *out,
+			size_t width);
+void draw_sparkline(int x, int y, int width, struct history *h,
+			uintattr_t fg);
+void chart_reset(void);
+int chart_parse(const char *data, size_t len);
+void chart_zoom(int delta);
+void draw_chart(const char *symbol, const char *name, struct history *h);
@@ -1,2 +1,19 @@
 #define INTERVAL 30 /* update informations every x seconds */
 #define REFRESH 1000 /* refresh screen every x milliseconds */
+#define CONNECT_TIMEOUT 5000 /* give up connecting after x milliseconds */
+#define TIMEOUT 10000 /* request deadline in milliseconds, hedge included */
+#define HEDGE 1 /* resend requests slower than the p95 latency, 0 to disable */
+#define RATE 10 /* requests per second sent to a host */
+#define BURST 20 /* requests sent to a host at once before RATE applies */
+#define STREAMS 64 /* requests in flight, multiplexed over HTTP/2 */
+#define HISTORY 512 /* price ticks kept per symbol, a multiple of 8 */
+#define JOURNAL_SYNC 1000 /* fsync the tick journal every x milliseconds */
+#define JOURNAL_SIZE (64 << 20) /* start a new journal file after x bytes */
+#define STREAM_SYNC 200 /* flush --headless output every x milliseconds */
+#define BUS_POLL 100 /* read the quotes of a --daemon every x milliseconds */
+#define SERVER_CLIENTS 64 /* clients of the --listen socket */
+#define SERVER_QUEUE 1024 /* quotes queued per client before dropping */
+#define STALE 120 /* dim rows with quotes older than x seconds */
+#define SPARKLINE 24 /* widest sparkline column, 0 to hide it */
+#define CANDLES 2048 /* candles kept by the chart view */
+#define TRACE_EVENTS 65536 /* spans kept per thread by --trace */
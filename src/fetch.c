@@ -0,0 +1,395 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <pthread.h>
+#include <curl/curl.h>
+#include "fetch.h"
+#include "stats.h"
+#include "limit.h"
+#include "replay.h"
+#include "trace.h"
+#include "strlcpy.h"
+#include "config.h"
+
+#define HEDGE_SAMPLES 20 /* latencies needed before hedging */
+
+extern const char alloc_fail[];
+
+struct mem {
+	char *memory;
+	size_t size;
+};
+
+struct transfer {
+	CURL *curl;
+	struct mem chunk;
+	long retry_after;
+};
+
+/* a request in flight, sent twice when hedged */
+struct request {
+	char url[2048];
+	struct transfer t[2];
+	int n, failed;
+	long start, deadline, hedge_at, status;
+	long replay_at; /* arrival of a replayed response, -1 over curl */
+	long traced; /* start in microseconds, for its trace span */
+	unsigned long id;
+	CURLcode res;
+	fetch_cb done;
+	void *userdata;
+};
+static struct request requests[STREAMS];
+static int pending = 0;
+static unsigned long sent = 0;
+
+static CURLM *multi = NULL;
+static pthread_mutex_t abort_lock = PTHREAD_MUTEX_INITIALIZER;
+static int aborted = 0;
+
+static int fetch_aborted() {
+
+	int ret;
+
+	pthread_mutex_lock(&abort_lock);
+	ret = aborted;
+	pthread_mutex_unlock(&abort_lock);
+	return ret;
+}
+
+/* abort every transfer in progress and wake up the fetcher */
+void fetch_abort() {
+
+	pthread_mutex_lock(&abort_lock);
+	aborted = 1;
+	pthread_mutex_unlock(&abort_lock);
+	if (multi) curl_multi_wakeup(multi);
+}
+
+/* interrupt fetch_poll() to have new requests sent */
+void fetch_wakeup() {
+	if (multi) curl_multi_wakeup(multi);
+}
+
+static int xferinfo(void *p, curl_off_t dltotal, curl_off_t dlnow,
+			curl_off_t ultotal, curl_off_t ulnow) {
+	(void)p; (void)dltotal; (void)dlnow; (void)ultotal; (void)ulnow;
+	return fetch_aborted();
+}
+
+static size_t writecb(void *contents, size_t size, size_t nmemb, void *userp) {
+
+	size_t realsize = size * nmemb;
+	struct mem *mem = (struct mem*)userp;
+
+	mem->memory = realloc(mem->memory, mem->size + realsize + 1);
+	if(mem->memory == NULL) {
+		printf(alloc_fail);
+		return 0;
+	}
+
+	memcpy(&(mem->memory[mem->size]), contents, realsize);
+	mem->size += realsize;
+	stats_count(COUNT_RECEIVED, realsize);
+	mem->memory[mem->size] = 0;
+	return realsize;
+}
+
+/* keep the Retry-After delay of throttled responses, in seconds */
+static size_t headercb(char *buffer, size_t size, size_t nitems,
+			void *userp) {
+
+	const char name[] = "retry-after:";
+	struct transfer *t = userp;
+	size_t len = size * nitems;
+	char value[64];
+	time_t date;
+
+	if (len <= sizeof(name) - 1 || len - sizeof(name) + 1 >= sizeof(value) ||
+			strncasecmp(buffer, name, sizeof(name) - 1))
+		return len;
+
+	memcpy(value, buffer + sizeof(name) - 1, len - sizeof(name) + 1);
+	value[len - sizeof(name) + 1] = '\0';
+	t->retry_after = atol(value);
+	if (!t->retry_after) {
+		date = curl_getdate(value, NULL);
+		if (date > 0) t->retry_after = date - time(NULL);
+	}
+	return len;
+}
+
+int fetch_init() {
+
+	srand(time(NULL));
+	if (curl_global_init(CURL_GLOBAL_ALL)) return -1;
+	multi = curl_multi_init();
+	if (!multi) {
+		curl_global_cleanup();
+		return -1;
+	}
+	/* multiplex requests to a host as HTTP/2 streams of one connection */
+	curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#if LIBCURL_VERSION_NUM >= 0x074300
+	curl_multi_setopt(multi, CURLMOPT_MAX_CONCURRENT_STREAMS, (long)STREAMS);
+#endif
+	return 0;
+}
+
+static int new_transfer(struct request *r, int i, long timeout) {
+
+	struct transfer *t = &r->t[i];
+	CURL *curl_handle;
+
+	t->chunk.memory = malloc(1);
+	if (!t->chunk.memory) {
+		printf(alloc_fail);
+		return -1;
+	}
+	t->chunk.size = 0;
+	t->retry_after = 0;
+
+	curl_handle = curl_easy_init();
+	if (!curl_handle) {
+		free(t->chunk.memory);
+		return -1;
+	}
+	curl_easy_setopt(curl_handle, CURLOPT_URL, r->url);
+	curl_easy_setopt(curl_handle, CURLOPT_PRIVATE, (void*)r);
+	curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, writecb);
+	curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void*)&t->chunk);
+	curl_easy_setopt(curl_handle, CURLOPT_HEADERFUNCTION, headercb);
+	curl_easy_setopt(curl_handle, CURLOPT_HEADERDATA, (void*)t);
+	curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "libcurl-agent/1.0");
+	curl_easy_setopt(curl_handle, CURLOPT_NOSIGNAL, 1L);
+	curl_easy_setopt(curl_handle, CURLOPT_CONNECTTIMEOUT_MS,
+			(long)CONNECT_TIMEOUT);
+	curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT_MS, timeout);
+	curl_easy_setopt(curl_handle, CURLOPT_NOPROGRESS, 0L);
+	curl_easy_setopt(curl_handle, CURLOPT_XFERINFOFUNCTION, xferinfo);
+	curl_easy_setopt(curl_handle, CURLOPT_HTTP_VERSION,
+			(long)CURL_HTTP_VERSION_2TLS);
+	if (i) {
+		/* a hedge is meant to reach another server */
+		curl_easy_setopt(curl_handle, CURLOPT_FRESH_CONNECT, 1L);
+	} else {
+		/* wait for the connection to be shared rather than opening more */
+		curl_easy_setopt(curl_handle, CURLOPT_PIPEWAIT, 1L);
+	}
+#if LIBCURL_VERSION_NUM >= 0x075700
+	/* don't wait for a pending name resolution on abort */
+	curl_easy_setopt(curl_handle, CURLOPT_QUICK_EXIT, 1L);
+#endif
+
+	curl_multi_add_handle(multi, curl_handle);
+	t->curl = curl_handle;
+	return 0;
+}
+
+/* time spent by the winning transfer of a request in each phase */
+static void phases(CURL *curl, long connects) {
+#if LIBCURL_VERSION_NUM >= 0x073d00
+	curl_off_t dns = 0, tcp = 0, tls = 0, pretransfer = 0, total = 0;
+
+	curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &dns);
+	curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &tcp);
+	curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &tls);
+	curl_easy_getinfo(curl, CURLINFO_PRETRANSFER_TIME_T, &pretransfer);
+	curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total);
+
+	/* a reused connection skips the first phases */
+	if (connects) {
+		stats_phase(PHASE_DNS, dns);
+		stats_phase(PHASE_CONNECT, tcp - dns);
+		if (tls) stats_phase(PHASE_TLS, tls - tcp);
+	}
+	stats_phase(PHASE_TRANSFER, total - pretransfer);
+#else
+	(void)curl;
+	(void)connects;
+#endif
+}
+
+/* release a request, handing the winner body to its callback */
+static void finish(struct request *r, int winner) {
+
+	long connects;
+	int i;
+
+	trace_async("fetch", r->id, r->traced);
+	for (i = 0; i < r->n && r->replay_at == -1; i++) {
+		connects = 0;
+		curl_easy_getinfo(r->t[i].curl, CURLINFO_NUM_CONNECTS, &connects);
+		stats_transfer(connects);
+		if (i == winner) phases(r->t[i].curl, connects);
+		curl_multi_remove_handle(multi, r->t[i].curl);
+		curl_easy_cleanup(r->t[i].curl);
+		if (i != winner) free(r->t[i].chunk.memory);
+	}
+	r->n = 0;
+	pending--;
+	stats_count(COUNT_PENDING, -1);
+
+	if (winner == -1) {
+		if (r->res != CURLE_OK && r->res != CURLE_ABORTED_BY_CALLBACK)
+			fprintf(stderr, "curl_easy_perform() failed: %s\n",
+				curl_easy_strerror(r->res));
+		else if (r->res == CURLE_OK)
+			fprintf(stderr, "request failed: HTTP %ld\n", r->status);
+		r->done(r->userdata, NULL, 0);
+		return;
+	}
+	stats_latency(now_ms() - r->start);
+	replay_save(r->url, r->t[winner].chunk.memory, r->t[winner].chunk.size);
+	r->done(r->userdata, r->t[winner].chunk.memory,
+		r->t[winner].chunk.size);
+}
+
+void fetch_cleanup() {
+
+	size_t i;
+
+	for (i = 0; i < STREAMS; i++) {
+		if (!requests[i].n) continue;
+		requests[i].res = CURLE_ABORTED_BY_CALLBACK;
+		finish(&requests[i], -1);
+	}
+	curl_multi_cleanup(multi);
+	multi = NULL;
+	curl_global_cleanup();
+}
+
+size_t fetch_pending() {
+	return pending;
+}
+
+/*
+ * Send a request for url, done is called by fetch_poll() with the body of
+ * a 2xx response, which it must free, or with NULL on failure. Requests
+ * go through the per host rate limiter: returns 0 once sent, the number of
+ * milliseconds to wait before trying again, or -1 on error.
+ */
+long fetch_add(char *url, fetch_cb done, void *userdata) {
+
+	struct request *r = NULL;
+	size_t i;
+	long wait, p[PERCENTILES];
+
+	for (i = 0; i < STREAMS && !r; i++)
+		if (!requests[i].n) r = &requests[i];
+	if (!r) return 1000;
+
+	if (strlcpy(r->url, url, sizeof(r->url)) >= sizeof(r->url)) return -1;
+	if (!replaying() && (wait = limit_acquire(url))) return wait;
+
+	r->start = now_ms();
+	r->traced = now_us();
+	r->id = ++sent;
+	r->deadline = r->start + TIMEOUT;
+	r->hedge_at = -1;
+	r->replay_at = -1;
+	if (HEDGE && stats_samples() >= HEDGE_SAMPLES && !replaying() &&
+			!stats_percentiles(p))
+		r->hedge_at = r->start + p[1];
+	r->failed = 0;
+	r->status = 0;
+	r->res = CURLE_OK;
+	r->done = done;
+	r->userdata = userdata;
+
+	if (replaying()) r->replay_at = r->start + replay_delay();
+	else if (new_transfer(r, 0, TIMEOUT)) return -1;
+	r->n = 1;
+	pending++;
+	stats_count(COUNT_PENDING, 1);
+	return 0;
+}
+
+static void transfer_done(CURL *curl, CURLcode res) {
+
+	struct request *r;
+	int i;
+
+	curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char**)&r);
+	for (i = 0; i < r->n && r->t[i].curl != curl; i++) ;
+	if (i == r->n) return;
+
+	r->res = res;
+	if (res == CURLE_OK) {
+		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &r->status);
+		limit_result(r->url, r->status, r->t[i].retry_after);
+		if (r->status >= 200 && r->status < 300) {
+			finish(r, i);
+			return;
+		}
+	}
+	if (++r->failed == r->n) finish(r, -1);
+}
+
+/* serve a request from the recorded responses, as a 404 if missing */
+static void replay(struct request *r) {
+
+	struct transfer *t = &r->t[0];
+
+	t->chunk.memory = replay_load(r->url, &t->chunk.size);
+	r->status = t->chunk.memory ? 200 : 404;
+	finish(r, t->chunk.memory ? 0 : -1);
+}
+
+/*
+ * Run the requests in flight, waiting at most timeout milliseconds for
+ * network activity. Requests past the p95 latency are hedged when HEDGE
+ * is set, and the ones past the TIMEOUT deadline are given up.
+ */
+void fetch_poll(long timeout) {
+
+	struct request *r;
+	CURLMsg *msg;
+	int running, left;
+	long now;
+	size_t i;
+
+	now = now_ms();
+	for (i = 0; i < STREAMS; i++) {
+		r = &requests[i];
+		if (!r->n) continue;
+		if (fetch_aborted()) {
+			r->res = CURLE_ABORTED_BY_CALLBACK;
+			finish(r, -1);
+			continue;
+		}
+		if (now >= r->deadline) {
+			r->res = CURLE_OPERATION_TIMEDOUT;
+			finish(r, -1);
+			continue;
+		}
+		if (r->replay_at != -1 && now >= r->replay_at) {
+			replay(r);
+			continue;
+		}
+		if (r->replay_at != -1 && r->replay_at - now < timeout)
+			timeout = r->replay_at - now;
+		if (r->n == 1 && r->hedge_at != -1 && now >= r->hedge_at) {
+			if (!limit_acquire(r->url) &&
+					!new_transfer(r, 1, r->deadline - now))
+				r->n++;
+			r->hedge_at = -1;
+		}
+		if (r->hedge_at != -1 && r->hedge_at - now < timeout)
+			timeout = r->hedge_at - now;
+		if (r->deadline - now < timeout)
+			timeout = r->deadline - now;
+	}
+	if (fetch_aborted()) return;
+
+	trace_begin("perform");
+	curl_multi_perform(multi, &running);
+	trace_end();
+	while ((msg = curl_multi_info_read(multi, &left)))
+		if (msg->msg == CURLMSG_DONE)
+			transfer_done(msg->easy_handle, msg->data.result);
+
+	if (timeout > 0) curl_multi_poll(multi, NULL, 0, timeout, NULL);
+}
@@ -0,0 +1,8 @@
+typedef void (*fetch_cb)(void *userdata, char *data, size_t len);
+int fetch_init(void);
+void fetch_cleanup(void);
+void fetch_abort(void);
+void fetch_wakeup(void);
+size_t fetch_pending(void);
+long fetch_add(char *url, fetch_cb done, void *userdata);
+void fetch_poll(long timeout);
@@ -0,0 +1,96 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "history.h"
+#include "config.h"
+
+#ifdef __GNUC__
+#define barrier() __sync_synchronize()
+#else
+#define barrier()
+#endif
+
+#define CACHE_LINE 64
+
+/*
+ * Ring buffer of the last HISTORY ticks of a symbol, written by the fetcher
+ * and read by the UI without locking. head counts the ticks ever written
+ * and lives on its own cache line, away from the ticks being written.
+ */
+struct history {
+	volatile uint32_t head;
+	char pad[CACHE_LINE - sizeof(uint32_t)];
+	struct tick ticks[HISTORY];
+};
+
+struct history *history_new() {
+
+	void *h;
+
+	if (posix_memalign(&h, CACHE_LINE, sizeof(struct history))) return NULL;
+	memset(h, 0, sizeof(struct history));
+	return h;
+}
+
+void history_free(struct history *h) {
+	free(h);
+}
+
+/* only called from the fetcher thread */
+void history_push(struct history *h, uint32_t time, float price) {
+
+	uint32_t head = h->head;
+
+	h->ticks[head % HISTORY].time = time;
+	h->ticks[head % HISTORY].price = price;
+	barrier();
+	h->head = head + 1;
+}
+
+/*
+ * Copy up to the last max ticks into buf, oldest first, returns the number
+ * of ticks copied. Ticks overwritten while copying are dropped.
+ */
+size_t history_read(struct history *h, struct tick *buf, size_t max) {
+
+	uint32_t head, first, valid, i;
+	size_t len;
+
+	head = h->head;
+	barrier();
+	len = head < HISTORY ? head : HISTORY;
+	if (len > max) len = max;
+	first = head - len;
+
+	for (i = 0; i < len; i++) buf[i] = h->ticks[(first + i) % HISTORY];
+
+	/* the slot after head may be under rewrite */
+	barrier();
+	head = h->head;
+	valid = head - HISTORY + 1;
+	if (head >= HISTORY && valid > first) {
+		size_t drop = valid - first;
+		if (drop >= len) return 0;
+		memmove(buf, buf + drop, (len - drop) * sizeof(*buf));
+		len -= drop;
+	}
+	return len;
+}
+
+/* percent change over the last seconds, -1 without enough ticks */
+int history_change(struct history *h, uint32_t seconds, float *change) {
+
+	struct tick ticks[HISTORY];
+	size_t len, i;
+
+	len = history_read(h, ticks, HISTORY);
+	if (len < 2) return -1;
+
+	/* latest tick at least that old, or the oldest one */
+	for (i = len - 1; i > 0; i--)
+		if (ticks[len - 1].time - ticks[i].time >= seconds) break;
+	if (!ticks[i].price) return -1;
+
+	*change = ticks[len - 1].price / ticks[i].price * 100 - 100;
+	return 0;
+}
@@ -0,0 +1,10 @@
+struct tick {
+	uint32_t time; /* seconds since the epoch */
+	float price;
+};
+struct history;
+struct history *history_new(void);
+void history_free(struct history *h);
+void history_push(struct history *h, uint32_t time, float price);
+size_t history_read(struct history *h, struct tick *buf, size_t max);
+int history_change(struct history *h, uint32_t seconds, float *change);
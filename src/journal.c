@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include "journal.h"
+#include "strlcpy.h"
+#include "stats.h"
+#include "config.h"
+
+#define JOURNAL_MAGIC "tuimarket journal 2"
+#define JOURNAL_BUFFER 256 /* records written at once */
+
+/* writer state, only used from the fetcher thread */
+static char journal_dir[1024];
+static int journal_fd = -1;
+static size_t journal_written = 0;
+static int journal_day = -1;
+static long journal_synced = 0;
+static struct journal_record journal_buffer[JOURNAL_BUFFER];
+static size_t journal_buffered = 0;
+/* journal id + 1 of each symbol in the current file, 0 until defined */
+static uint32_t *journal_defined = NULL;
+static size_t journal_defined_length = 0;
+static uint32_t journal_ids = 0;
+
+static int write_all(int fd, const void *buf, size_t len) {
+
+	const char *p = buf;
+	ssize_t ret;
+
+	while (len) {
+		ret = write(fd, p, len);
+		if (ret == -1 && errno == EINTR) continue;
+		if (ret <= 0) return -1;
+		p += ret;
+		len -= ret;
+	}
+	return 0;
+}
+
+static void flush() {
+
+	if (journal_fd == -1 || !journal_buffered) return;
+	if (write_all(journal_fd, journal_buffer,
+			journal_buffered * sizeof(*journal_buffer))) {
+		close(journal_fd);
+		journal_fd = -1;
+	}
+	journal_buffered = 0;
+}
+
+static void push(const struct journal_record *record) {
+
+	if (journal_buffered == JOURNAL_BUFFER) flush();
+	journal_buffer[journal_buffered++] = *record;
+	journal_written += sizeof(*record);
+}
+
+/* start a new file named after the current local time */
+static int rotate(const struct tm *tm) {
+
+	struct journal_record header;
+	char name[64], path[sizeof(journal_dir) + sizeof(name)];
+	int i;
+
+	flush();
+	if (journal_fd != -1) {
+		fsync(journal_fd);
+		close(journal_fd);
+	}
+
+	strftime(name, sizeof(name), "%Y%m%d-%H%M%S", tm);
+	for (i = 0; i < 100; i++) {
+		if (i) snprintf(path, sizeof(path), "%s/%s-%d.tick",
+				journal_dir, name, i);
+		else snprintf(path, sizeof(path), "%s/%s.tick",
+				journal_dir, name);
+		journal_fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+		if (journal_fd != -1 || errno != EEXIST) break;
+	}
+	if (journal_fd == -1) return -1;
+
+	journal_day = tm->tm_yday;
+	journal_written = 0;
+	memset(journal_defined, 0,
+		journal_defined_length * sizeof(*journal_defined));
+	journal_ids = 0;
+
+	memset(&header, 0, sizeof(header));
+	header.type = JOURNAL_HEADER;
+	header.id = sizeof(header);
+	strlcpy(header.u.magic, JOURNAL_MAGIC, sizeof(header.u.magic));
+	push(&header);
+	return 0;
+}
+
+/* record ticks into dir, which must exist */
+int journal_open(const char *dir) {
+
+	struct stat st;
+	struct tm tm;
+	time_t now;
+
+	if (stat(dir, &st) || !S_ISDIR(st.st_mode)) return -1;
+	if (strlcpy(journal_dir, dir, sizeof(journal_dir)) >=
+			sizeof(journal_dir))
+		return -1;
+
+	now = time(NULL);
+	journal_synced = now_ms();
+	return rotate(localtime_r(&now, &tm));
+}
+
+void journal_close() {
+	journal_sync(1);
+	if (journal_fd != -1) close(journal_fd);
+	journal_fd = -1;
+	free(journal_defined);
+	journal_defined = NULL;
+	journal_defined_length = 0;
+}
+
+/* write buffered records and fsync them every JOURNAL_SYNC milliseconds */
+void journal_sync(int force) {
+
+	long now;
+
+	if (journal_fd == -1) return;
+	now = now_ms();
+	if (!force && now - journal_synced < JOURNAL_SYNC) return;
+	flush();
+	if (journal_fd != -1) fsync(journal_fd);
+	journal_synced = now;
+}
+
+void journal_append(uint32_t id, const char *symbol, float price,
+			float previous_price) {
+
+	struct journal_record record;
+	struct timeval tv;
+	time_t now;
+	struct tm tm;
+
+	if (journal_fd == -1) return;
+
+	gettimeofday(&tv, NULL);
+	now = tv.tv_sec;
+	localtime_r(&now, &tm);
+	if (tm.tm_yday != journal_day || journal_written >= JOURNAL_SIZE) {
+		journal_sync(1);
+		if (rotate(&tm)) return;
+	}
+
+	if (id >= journal_defined_length) {
+		uint32_t *defined;
+		size_t length = ((size_t)id + 1) * 2;
+		defined = realloc(journal_defined, length * sizeof(*defined));
+		if (!defined) return;
+		memset(defined + journal_defined_length, 0,
+			(length - journal_defined_length) * sizeof(*defined));
+		journal_defined = defined;
+		journal_defined_length = length;
+	}
+
+	memset(&record, 0, sizeof(record));
+	if (!journal_defined[id]) {
+		record.type = JOURNAL_SYMBOL;
+		record.id = journal_ids;
+		strlcpy(record.u.symbol, symbol, sizeof(record.u.symbol));
+		push(&record);
+		journal_defined[id] = ++journal_ids;
+		memset(&record.u, 0, sizeof(record.u));
+	}
+	record.id = journal_defined[id] - 1;
+
+	record.type = JOURNAL_TICK;
+	record.u.tick.time = tv.tv_sec;
+	record.u.tick.msec = tv.tv_usec / 1000;
+	record.u.tick.price = price;
+	record.u.tick.previous_price = previous_price;
+	push(&record);
+
+	journal_sync(0);
+}
+
+/*
+ * Map a journal file read-only. Records are used in place, only the table
+ * of symbol names pointing into the mapping is allocated.
+ */
+int journal_map(struct journal *j, const char *path) {
+
+	struct stat st;
+	size_t i;
+	int fd;
+
+	memset(j, 0, sizeof(*j));
+	fd = open(path, O_RDONLY);
+	if (fd == -1) return -1;
+	if (fstat(fd, &st)) {
+		close(fd);
+		return -1;
+	}
+	if ((size_t)st.st_size < sizeof(*j->records)) {
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+
+	j->size = st.st_size;
+	j->map = mmap(NULL, j->size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (j->map == MAP_FAILED) return -1;
+
+	j->records = j->map;
+	j->length = j->size / sizeof(*j->records);
+	if (j->records[0].type != JOURNAL_HEADER ||
+			j->records[0].id != sizeof(*j->records) ||
+			strncmp(j->records[0].u.magic, JOURNAL_MAGIC,
+				sizeof(j->records[0].u.magic))) {
+		journal_unmap(j);
+		errno = EINVAL;
+		return -1;
+	}
+#ifdef POSIX_MADV_SEQUENTIAL
+	posix_madvise(j->map, j->size, POSIX_MADV_SEQUENTIAL);
+#endif
+
+	/* ids are given in order from 0, each by one symbol record */
+	for (i = 1; i < j->length; i++)
+		if (j->records[i].type == JOURNAL_SYMBOL) j->names_length++;
+	if (j->names_length) {
+		j->names = calloc(j->names_length, sizeof(*j->names));
+		if (!j->names) {
+			journal_unmap(j);
+			return -1;
+		}
+	}
+	for (i = 1; i < j->length; i++) {
+		const struct journal_record *r = &j->records[i];
+		if (r->type != JOURNAL_SYMBOL) continue;
+		if (r->id >= j->names_length || j->names[r->id]) {
+			journal_unmap(j);
+			errno = EINVAL;
+			return -1;
+		}
+		j->names[r->id] = r->u.symbol;
+	}
+	return 0;
+}
+
+void journal_unmap(struct journal *j) {
+	if (j->map && j->map != MAP_FAILED) munmap(j->map, j->size);
+	free(j->names);
+	memset(j, 0, sizeof(*j));
+}
+
+const char *journal_name(const struct journal *j, uint32_t id) {
+	return id < j->names_length ? j->names[id] : NULL;
+}
@@ -0,0 +1,42 @@
+#define JOURNAL_HEADER 0
+#define JOURNAL_SYMBOL 1
+#define JOURNAL_TICK 2
+
+/*
+ * Journal files are arrays of 32 bytes records in host byte order. The
+ * first record is a header, a symbol record names an id before its first
+ * tick in each file. Ids are numbered from 0 in each file.
+ */
+struct journal_record {
+	uint32_t type;
+	uint32_t id;
+	union {
+		struct {
+			uint32_t time; /* seconds since the epoch */
+			uint32_t msec;
+			float price;
+			float previous_price;
+			uint32_t reserved[2];
+		} tick;
+		char symbol[24];
+		char magic[24];
+	} u;
+};
+
+struct journal {
+	void *map;
+	size_t size;
+	const struct journal_record *records;
+	size_t length;
+	const char **names;
+	size_t names_length;
+};
+
+int journal_open(const char *dir);
+void journal_close(void);
+void journal_append(uint32_t id, const char *symbol, float price,
+			float previous_price);
+void journal_sync(int force);
+int journal_map(struct journal *j, const char *path);
+void journal_unmap(struct journal *j);
+const char *journal_name(const struct journal *j, uint32_t id);
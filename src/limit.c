@@ -0,0 +1,113 @@
+#include <stdlib.h>
+#include <string.h>
+#include "limit.h"
+#include "stats.h"
+#include "config.h"
+
+#define HOSTS 16
+#define BACKOFF_BASE 500 /* first backoff in milliseconds */
+#define BACKOFF_MAX 60000
+
+/* token bucket and backoff state of a host */
+struct host {
+	char name[256];
+	double tokens;
+	long refill;
+	long blocked_until;
+	int failures;
+	long used; /* last lookup, to evict the least recently used */
+};
+static struct host hosts[HOSTS];
+static size_t hosts_length = 0;
+static int disabled = 0;
+
+static struct host *get_host(const char *url) {
+
+	const char *start, *end;
+	struct host *host;
+	size_t len, i;
+	long now = now_ms();
+
+	start = strstr(url, "://");
+	start = start ? start + 3 : url;
+	end = start;
+	while (*end && *end != '/' && *end != ':' && *end != '?') end++;
+	len = end - start;
+	if (len >= sizeof(host->name)) len = sizeof(host->name) - 1;
+
+	for (i = 0; i < hosts_length; i++) {
+		if (!strncmp(hosts[i].name, start, len) &&
+				!hosts[i].name[len]) {
+			hosts[i].used = now;
+			return &hosts[i];
+		}
+	}
+
+	/* reuse the least recently used entry once the table is full */
+	if (hosts_length < HOSTS) host = &hosts[hosts_length++];
+	else {
+		host = &hosts[0];
+		for (i = 1; i < HOSTS; i++)
+			if (hosts[i].used < host->used) host = &hosts[i];
+	}
+	memcpy(host->name, start, len);
+	host->name[len] = '\0';
+	host->tokens = BURST;
+	host->refill = now;
+	host->blocked_until = 0;
+	host->failures = 0;
+	host->used = now;
+	return host;
+}
+
+/*
+ * Take a request token for the host of url. Returns 0 on success, or the
+ * number of milliseconds to wait before trying again.
+ */
+long limit_acquire(const char *url) {
+
+	struct host *host;
+	long now;
+
+	if (disabled) return 0;
+	host = get_host(url);
+	now = now_ms();
+	if (now < host->blocked_until) return host->blocked_until - now;
+
+	host->tokens += (now - host->refill) * RATE / 1000.0;
+	if (host->tokens > BURST) host->tokens = BURST;
+	host->refill = now;
+
+	if (host->tokens < 1) return (1 - host->tokens) * 1000 / RATE + 1;
+	host->tokens--;
+	return 0;
+}
+
+/*
+ * Report the HTTP status of a request to the host of url. Throttling and
+ * server errors back off exponentially with jitter, or for retry_after
+ * seconds when the server asked for it.
+ */
+void limit_result(const char *url, long status, long retry_after) {
+
+	struct host *host = get_host(url);
+	long backoff;
+
+	if (status != 429 && status < 500) {
+		host->failures = 0;
+		return;
+	}
+
+	if (host->failures < 16) host->failures++;
+	backoff = BACKOFF_BASE << (host->failures - 1);
+	if (backoff > BACKOFF_MAX) backoff = BACKOFF_MAX;
+	backoff = backoff / 2 + rand() % (backoff / 2 + 1);
+	if (retry_after * 1000 > backoff) backoff = retry_after * 1000;
+
+	host->blocked_until = now_ms() + backoff;
+}
+
+/* let every request through, for benchmarks against a local server */
+void limit_disable() {
+	disabled = 1;
+}
@@ -0,0 +1,3 @@
+long limit_acquire(const char *url);
+void limit_result(const char *url, long status, long retry_after);
+void limit_disable(void);
@@ -8,10 +8,29 @@
 #include <time.h>
 #include <pthread.h>
 #include <errno.h>
-#include <curl/curl.h>
+#include <signal.h>
+#include <sys/resource.h>
 #include "termbox.h" 
 #include "strlcpy.h" 
 #include "strnstr.h"
+#include "fetch.h"
+#include "stats.h"
+#include "history.h"
+#include "journal.h"
+#include "chart.h"
+#include "options.h"
+#include "symbol.h"
+#include "sort.h"
+#include "movers.h"
+#include "search.h"
+#include "alerts.h"
+#include "portfolio.h"
+#include "stream.h"
+#include "bus.h"
+#include "server.h"
+#include "replay.h"
+#include "limit.h"
+#include "trace.h"
 #include "config.h"
 
 #ifndef PATH_MAX
@@ -21,78 +40,48 @@
 
 const char alloc_fail[] = "memory allocation failure\n";
 
-struct symbol {
-	char symbol[16];
-	char name[256];
-	float price;
-	float previous_price;
-};
 struct symbol *symbols = NULL;
 size_t symbols_length = 0;
 
-const char query_price[] =
-	"https://query2.finance.yahoo.com/v7/finance/options/%s";
-
-const char *paths[] = {
-	".config/tuimarket/symbols",
-	".tuimarket/symbols",
-	".tuimarket_symbols",
-};
-
-struct mem {
-	char *memory;
-	size_t size;
-};
-struct mem chunk;
-
-static size_t writecb(void *contents, size_t size, size_t nmemb, void *userp) {
+/* symbols currently shown by display(), fetched first by update_thread */
+pthread_mutex_t view_lock = PTHREAD_MUTEX_INITIALIZER;
+size_t *view = NULL, view_length = 0, view_capacity = 0;
+long start_time = 0, first_screen = -1;
 
-	size_t realsize = size * nmemb;
-	struct mem *mem = (struct mem*)userp;
+/* cleared on exit, the fetcher is woken up by fetch_abort() */
+pthread_mutex_t run_lock = PTHREAD_MUTEX_INITIALIZER;
+int run = 0;
 
-	mem->memory = realloc(mem->memory, mem->size + realsize + 1);
-	if(mem->memory == NULL) {
-		printf(alloc_fail);
-		return 0;
-	}
+/* base URL of the quote API, --server points it to another host */
+const char *server = "https://query2.finance.yahoo.com";
+const char query_price[] = "%s/v7/finance/options/%s";
+const char query_chart[] = "%s/v8/finance/chart/%s?range=1d&interval=1m";
 
-	memcpy(&(mem->memory[mem->size]), contents, realsize);
-	mem->size += realsize;
-	mem->memory[mem->size] = 0;
-	return realsize;
-}
+/* cycles fetched by --bench before exiting */
+unsigned int bench = 0;
 
-char *handle_url(char *url, size_t *len) {
-
-	CURL *curl_handle;
-	CURLcode res;
-
-	chunk.memory = malloc(1);
-	if (!chunk.memory) {
-		printf(alloc_fail);
-		return NULL;
-	}
-	chunk.size = 0;
+/* performance overlay toggled by F12, measures of the last frame */
+int overlay = 0;
+long frame_time = 0, frame_bytes = 0;
+long rate_time = 0, rate_quotes = 0;
+double quote_rate = 0;
 
-	curl_handle = curl_easy_init();
-	curl_easy_setopt(curl_handle, CURLOPT_URL, url);
-	curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, writecb);
-	curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void*)&chunk);
-	curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "libcurl-agent/1.0");
+#define MODE_LIST 0
+#define MODE_CHART 1
+#define MODE_OPTIONS 2
+#define MODE_MOVERS 3
+int mode = MODE_LIST, cursor = 0, options_scroll = 0, searching = 0;
 
-	res = curl_easy_perform(curl_handle);
-	curl_easy_cleanup(curl_handle);
+/* symbols shown by the chart and options views, fetched when opened */
+struct symbol *chart_symbol = NULL, *options_symbol = NULL;
+int chart_wanted = 0, options_wanted = 0;
 
-	if(res != CURLE_OK) {
-		printf("curl_easy_perform() failed: %s\n",
-			curl_easy_strerror(res));
-		return NULL;
-	}
-
-	*len = chunk.size;
-
-	return chunk.memory;
-}
+char symbols_path[PATH_MAX];
+const char *paths[] = {
+	".config/tuimarket/symbols",
+	".tuimarket/symbols",
+	".tuimarket_symbols",
+};
 
 static ssize_t get_home(char *buf, size_t length) {
 
@@ -135,6 +124,7 @@ static int load_symbols() {
 		if (f) break;
 	}
 	if (!f) return -1;
+	strlcpy(symbols_path, path, sizeof(symbols_path));
 
 	for (i = 0; 1; i++) {
 
@@ -148,6 +138,12 @@ static int load_symbols() {
 
 		if (s.symbol[len - 1] == '\n') s.symbol[len - 1] = '\0';
 
+		s.history = history_new();
+		if (!s.history) {
+			printf(alloc_fail);
+			return -1;
+		}
+
 		symbols = realloc(symbols, (i + 1) * sizeof(struct symbol));
 		if (!symbols) {
 			printf(alloc_fail);
@@ -161,9 +157,17 @@ static int load_symbols() {
 	return 0;
 }
 
+/* path of a configuration file next to the symbols file */
+static void config_path(char *buf, size_t length, const char *name) {
+	int len = strlen(symbols_path) - (sizeof("symbols") - 1);
+	snprintf(buf, length, "%.*s%s", len, symbols_path, name);
+}
+
 const char str_price[] = "\"regularMarketPrice\":";
 const char str_old_price[] = "\"regularMarketPreviousClose\":";
 const char str_name[] = "\"shortName\":\"";
+const char str_time[] = "\"regularMarketTime\":";
+const char str_regular[] = "\"marketState\":\"REGULAR\"";
 
 static int find_copy(const char *haystack, const char *needle, size_t hay_len,
 			size_t needle_len, char stop, char *buf, size_t len) {
@@ -177,7 +181,7 @@ static int find_copy(const char *haystack, const char *needle, size_t hay_len,
 	end = start;
 	while (*end && *end != stop) end++;
 
-	if (!*end || (size_t)(end - start) > len) return -1;
+	if (!*end || (size_t)(end - start) >= len) return -1;
 
 	memcpy(buf, start, end - start);
 	buf[end - start] = '\0';
@@ -185,59 +189,229 @@ static int find_copy(const char *haystack, const char *needle, size_t hay_len,
 	return 0;
 }
 
-static int update_symbol(struct symbol *symbol) {
+static int parse_symbol(struct symbol *symbol, const char *data, size_t len) {
 
-	char url[2048], buf[64], *data;
-	size_t len;
-	int ret = -1;
-
-	snprintf(url, sizeof(url), query_price, symbol->symbol);
-	data = handle_url(url, &len);
-	if (!data) return -1;
+	char buf[64];
 
 	if (find_copy(data, str_price, len, sizeof(str_price), ',', buf,
 			sizeof(buf)))
-		goto clean;
+		return -1;
 	symbol->price = atof(buf);
 	
 	if (find_copy(data, str_old_price, len, sizeof(str_old_price), ',', buf,
 			sizeof(buf)))
-		goto clean;
+		return -1;
 	symbol->previous_price = atof(buf);
 
 	if (find_copy(data, str_name, len, sizeof(str_name), '"',
 			symbol->name, sizeof(symbol->name)))
-		goto clean;
+		return -1;
 
-	ret = 0;
-clean:
-	free(data);
+	/* optional, the age of the quote is unknown without them */
+	symbol->market_time = 0;
+	if (!find_copy(data, str_time, len, sizeof(str_time), ',', buf,
+			sizeof(buf)))
+		symbol->market_time = strtoul(buf, NULL, 10);
+	symbol->regular = strnstr(data, str_regular, len) != NULL;
+	return 0;
+}
+
+static int running() {
+
+	int ret;
 
+	pthread_mutex_lock(&run_lock);
+	ret = run;
+	pthread_mutex_unlock(&run_lock);
 	return ret;
 }
 
-void ansi_sleep(long micro) {
-        struct timeval tv;
-        tv.tv_sec = micro / 1000000;
-        tv.tv_usec = micro % 1000000;
-        select(0, NULL, NULL, NULL, &tv);
+static void stop() {
+
+	pthread_mutex_lock(&run_lock);
+	run = 0;
+	pthread_mutex_unlock(&run_lock);
+	fetch_abort();
+}
+
+/* pick the next symbol to fetch in this cycle, visible rows first */
+static size_t next_symbol(unsigned int cycle, size_t *cursor) {
+
+	size_t i, ret = symbols_length;
+
+	pthread_mutex_lock(&view_lock);
+	for (i = 0; i < view_length && ret == symbols_length; i++)
+		if (symbols[view[i]].cycle != cycle) ret = view[i];
+	pthread_mutex_unlock(&view_lock);
+	if (ret != symbols_length) return ret;
+
+	while (*cursor < symbols_length && symbols[*cursor].cycle == cycle)
+		(*cursor)++;
+	return *cursor;
+}
+
+/* record the time until every visible row got its first quote */
+static void check_first_screen() {
+
+	size_t i;
+	int loaded;
+
+	if (first_screen != -1) return;
+
+	/* nothing is on screen before the first display() */
+	pthread_mutex_lock(&view_lock);
+	loaded = view_length > 0;
+	for (i = 0; i < view_length; i++)
+		if (!symbols[view[i]].received) loaded = 0;
+	pthread_mutex_unlock(&view_lock);
+
+	if (loaded) first_screen = now_ms() - start_time;
+}
+
+/* record a new quote of symbol i, fetched or read from the bus */
+static void quoted(size_t i, uint32_t time) {
+
+	struct symbol *symbol = &symbols[i];
+
+	trace_begin("publish");
+	symbol->received = now_ms();
+	symbol->received_time = time;
+	stats_count(COUNT_QUOTES, 1);
+	if (symbol->regular && symbol->market_time)
+		stats_age((long)time - (long)symbol->market_time);
+	history_push(symbol->history, time, symbol->price);
+	journal_append(i, symbol->symbol, symbol->price,
+			symbol->previous_price);
+	sort_mark(i);
+	movers_update(i);
+	search_mark(i);
+	alerts_check(i);
+	portfolio_update(i);
+	stream_quote(symbol);
+	bus_publish(i, time);
+	server_publish(i, time);
+	trace_end();
 }
 
+static void update_symbol(void *userdata, char *data, size_t len) {
+
+	long start;
+	int options, parsed;
+
+	if (!data) return;
+	trace_begin("parse");
+	start = now_us();
+	parsed = parse_symbol(userdata, data, len);
+	stats_phase(PHASE_PARSE, now_us() - start);
+	trace_end();
+	if (!parsed) quoted((struct symbol*)userdata - symbols, time(NULL));
+
+	/* the quote comes with the option chain of the nearest expiration */
+	pthread_mutex_lock(&view_lock);
+	options = (userdata == options_symbol);
+	pthread_mutex_unlock(&view_lock);
+	if (options) {
+		trace_begin("parse options");
+		options_parse(data, len);
+		trace_end();
+	}
+
+	free(data);
+	check_first_screen();
+}
+
+static void update_bus(size_t i, uint32_t time) {
+	quoted(i, time);
+	check_first_screen();
+}
+
+static long queue_symbol(struct symbol *symbol) {
+
+	char url[2048];
+
+	snprintf(url, sizeof(url), query_price, server, symbol->symbol);
+	return fetch_add(url, update_symbol, symbol);
+}
+
+static void update_chart(void *userdata, char *data, size_t len) {
+
+	int current;
+
+	if (!data) return;
+	pthread_mutex_lock(&view_lock);
+	current = (userdata == chart_symbol);
+	pthread_mutex_unlock(&view_lock);
+	if (current) {
+		trace_begin("parse chart");
+		chart_parse(data, len);
+		trace_end();
+	}
+	free(data);
+}
+
+/* send the requests of the chart and options views once opened */
+static void queue_views() {
+
+	struct symbol *chart, *options;
+	char url[2048];
+
+	pthread_mutex_lock(&view_lock);
+	chart = chart_wanted ? chart_symbol : NULL;
+	options = options_wanted ? options_symbol : NULL;
+	pthread_mutex_unlock(&view_lock);
+
+	if (chart) {
+		snprintf(url, sizeof(url), query_chart, server,
+			chart->symbol);
+		if (fetch_add(url, update_chart, chart) > 0) chart = NULL;
+	}
+	if (options && queue_symbol(options) > 0) options = NULL;
+
+	pthread_mutex_lock(&view_lock);
+	if (chart && chart_symbol == chart) chart_wanted = 0;
+	if (options && options_symbol == options) options_wanted = 0;
+	pthread_mutex_unlock(&view_lock);
+}
+
+/*
+ * Send up to STREAMS requests at once, visible rows first. After the first
+ * cycle, requests are spread over INTERVAL seconds. Symbols published by a
+ * --daemon are read from the bus instead. --bench stops after its cycles.
+ */
 void *update_thread(void *ptr) {
 
-	int *run = ptr, interval, counter;
+	unsigned int cycle;
+	long interval, next, wait, limit;
+	size_t i, cursor;
 
+	trace_thread("fetcher");
 	interval = 0;
-	while (*run) {
-		size_t i;
-		for (i = 0; i < symbols_length; i++) {
-			update_symbol(&symbols[i]);
-			counter = 0;
-			while (counter++ < interval * 10 && *run)
-				ansi_sleep(100000 / symbols_length);
-			if (!*run) break;
+	next = 0;
+	for (cycle = 1; running(); cycle++) {
+		cursor = 0;
+		while (running()) {
+			bus_poll(update_bus);
+			queue_views();
+			wait = next - now_ms();
+			if (wait <= 0 && fetch_pending() < STREAMS) {
+				i = next_symbol(cycle, &cursor);
+				if (i >= symbols_length) {
+					if (!fetch_pending()) break;
+				} else if (bus_backed(i) ||
+					(wait = queue_symbol(&symbols[i])) <= 0) {
+					symbols[i].cycle = cycle;
+					next = now_ms() + interval / symbols_length;
+					continue;
+				}
+			}
+			limit = bus_attached() ? BUS_POLL : 1000;
+			fetch_poll(wait > 0 && wait < limit ? wait : limit);
+			journal_sync(0);
+			stream_sync(0);
+			trace_poll();
 		}
-		interval = INTERVAL;
+		if (cycle == bench) break;
+		if (!bench) interval = INTERVAL * 1000;
 	}
 	return ptr;
 }
@@ -246,92 +420,802 @@ void *update_thread(void *ptr) {
 #define COL_NAME (COL_SYMBOL + sizeof("Symbol |") + 1)
 #define COL_VARIATION (-(signed)sizeof("Variation") - 8)
 #define COL_PRICE (COL_VARIATION -(signed)sizeof("| Price") - 3)
+#define COL_WORTH 14 /* width of the portfolio columns */
+#define COL_TOTAL (COL_PRICE - COL_WORTH)
+#define COL_DAY (COL_TOTAL - COL_WORTH)
+#define COL_VALUE (COL_DAY - COL_WORTH)
+#define COL_SPARK(right, width) ((right) - (width) - 3)
+#define NAME_WIDTH 16 /* name room kept before showing a sparkline */
+
+/* rows of symbols on screen, the portfolio totals take the last line */
+static int list_rows() {
+	return tb_height() - 1 - (portfolio_length() ? 1 : 0) - overlay;
+}
 
-int display(int *scroll) {
+/* publish the symbols of the rows on screen to the fetcher */
+static void set_view(size_t first, size_t rows) {
+
+	size_t i, *p;
+
+	if (first + rows > search_length()) rows = search_length() - first;
+
+	pthread_mutex_lock(&view_lock);
+	if (rows > view_capacity) {
+		p = realloc(view, rows * sizeof(*view));
+		if (!p) rows = view_capacity;
+		else {
+			view = p;
+			view_capacity = rows;
+		}
+	}
+	for (i = 0; i < rows; i++) view[i] = search_row(first + i);
+	view_length = rows;
+	pthread_mutex_unlock(&view_lock);
+}
+
+/* flag the header of the sorted column */
+static void draw_sort_mark(int w) {
+
+	const char *mark = sort_reverse ? "^" : "v";
+
+	if (sort_column == SORT_SYMBOL) mark = sort_reverse ? "v" : "^";
+	switch (sort_column) {
+	case SORT_SYMBOL:
+		tb_print(COL_SYMBOL + sizeof("Symbol"), 0, TB_BLACK,
+			TB_WHITE, mark);
+		break;
+	case SORT_PRICE:
+		tb_print(w + COL_PRICE + sizeof("Price"), 0, TB_BLACK,
+			TB_WHITE, mark);
+		break;
+	case SORT_CHANGE:
+	case SORT_PERCENT:
+		tb_printf(w + COL_VARIATION + sizeof("Variation"), 0,
+			TB_BLACK, TB_WHITE, "%s%s", mark,
+			sort_column == SORT_PERCENT ? " %" : "");
+		break;
+	}
+}
+
+/* right aligned portfolio figure, colored by sign unless plain */
+static void draw_worth(int x, int y, double value, int plain, uintattr_t bg) {
+
+	uintattr_t fg = TB_DEFAULT;
+
+	if (!plain) fg = value >= 0 ? TB_GREEN : TB_RED;
+	if (bg != TB_DEFAULT) fg = TB_BLACK;
+	tb_printf(x, y, fg, bg, "%*.2f", COL_WORTH - 3, value);
+}
+
+#define DIM (TB_BLACK | TB_BOLD) /* grey on most terminals */
+
+/*
+ * Whether the quote of s is older than STALE seconds: received that long
+ * ago, or timestamped that long ago by an exchange in its regular session.
+ */
+static int stale(const struct symbol *s, long now, long wall) {
+	if (!s->received) return 0;
+	if (now - s->received > STALE * 1000) return 1;
+	return s->regular && s->market_time &&
+		wall - (long)s->market_time > STALE;
+}
+
+static void draw_list(int *scroll) {
 
-	struct tb_event ev;
 	struct symbol symbol;
-	int i, w, h, bottom;
+	size_t row;
+	double value, day, total;
+	int i, w, rows, spark, right;
+	long now = now_ms(), wall = time(NULL);
 
 	w = tb_width();
-	h = tb_height();
+	rows = list_rows();
+	right = portfolio_length() ? COL_VALUE : COL_PRICE;
 
-	if ((size_t)h > symbols_length) *scroll = 0;
+	spark = w + right - 3 - COL_NAME - NAME_WIDTH;
+	if (spark > SPARKLINE) spark = SPARKLINE;
+	if (spark < 8) spark = 0;
+
+	sort_update();
+	search_update();
+	if (cursor >= (int)search_length()) cursor = search_length() - 1;
+	if (cursor < 0) cursor = 0;
+	if (cursor < *scroll || (size_t)rows >= search_length()) *scroll = 0;
+	set_view(*scroll, rows);
 
-	tb_clear();
 	for (i = 0; i < w; i++) tb_set_cell(i, 0, ' ', TB_BLACK, TB_WHITE);
 
 	tb_print(COL_SYMBOL - 2, 0, TB_BLACK, TB_WHITE, " Symbol");
 	tb_print(COL_NAME - 2, 0, TB_BLACK, TB_WHITE, "| Name");
+	if (searching || *search_query())
+		tb_printf(COL_NAME + sizeof("Name"), 0, TB_BLACK, TB_WHITE,
+			"/%s%s", search_query(), searching ? "_" : "");
+	if (spark)
+		tb_print(w + COL_SPARK(right, spark) - 2, 0, TB_BLACK, TB_WHITE,
+				"| Trend");
+	if (portfolio_length()) {
+		tb_print(w + COL_VALUE - 2, 0, TB_BLACK, TB_WHITE, "| Value");
+		tb_print(w + COL_DAY - 2, 0, TB_BLACK, TB_WHITE, "| Day P&L");
+		tb_print(w + COL_TOTAL - 2, 0, TB_BLACK, TB_WHITE,
+				"| Total P&L");
+	}
 	tb_print(w + COL_PRICE - 2, 0, TB_BLACK, TB_WHITE, "| Price");
 	tb_print(w + COL_VARIATION - 2, 0, TB_BLACK, TB_WHITE, "| Variation");
-
-	bottom = 1;
-	for (i = *scroll; i < (int)symbols_length; i++) {
-		int gain, j, y = i + 1;
-		symbol = symbols[i];
+	draw_sort_mark(w);
+
+	for (i = *scroll; i < (int)search_length(); i++) {
+		int gain, j, y = i + 1 - *scroll;
+		uintattr_t fg = TB_DEFAULT, bg = TB_DEFAULT, text = TB_DEFAULT;
+		if (y > rows) break;
+		row = search_row(i);
+		symbol = symbols[row];
 		gain = (symbol.price >= symbol.previous_price);
-		tb_print(COL_SYMBOL, y - *scroll, TB_DEFAULT, TB_DEFAULT,
-				symbol.symbol);
-		tb_print(COL_NAME, y - *scroll, TB_DEFAULT, TB_DEFAULT,
-				symbol.name);
+		if (stale(&symbol, now, wall)) fg = text = DIM;
+		if (alerts_active(row)) {
+			fg = TB_BLACK;
+			bg = TB_YELLOW;
+		}
+		if (i == cursor) fg |= TB_REVERSE;
+		tb_print(COL_SYMBOL, y, fg, bg, symbol.symbol);
+		tb_print(COL_NAME, y, text, TB_DEFAULT, symbol.name);
 
-		j = w + COL_PRICE - 2;
+		j = w + (spark ? COL_SPARK(right, spark) : right) - 2;
 		while (j++ < w)
 			tb_set_cell(j, y, ' ', TB_DEFAULT, TB_DEFAULT);
-		tb_printf(w + COL_PRICE, y - *scroll, TB_DEFAULT, TB_DEFAULT,
+		if (spark)
+			draw_sparkline(w + COL_SPARK(right, spark), y, spark,
+				symbol.history, gain ? TB_GREEN : TB_RED);
+		if (!portfolio_position(row, &value, &day, &total)) {
+			draw_worth(w + COL_VALUE, y, value, 1, TB_DEFAULT);
+			draw_worth(w + COL_DAY, y, day, 0, TB_DEFAULT);
+			draw_worth(w + COL_TOTAL, y, total, 0, TB_DEFAULT);
+		}
+		tb_printf(w + COL_PRICE, y, text, TB_DEFAULT,
 				"%.2f", symbol.price);
-		tb_printf(w + COL_VARIATION + gain, y - *scroll,
+		tb_printf(w + COL_VARIATION + gain, y, text == DIM ? DIM :
 			gain ? TB_GREEN : TB_RED, TB_DEFAULT, "%.2f (%.2f%%)",
 			symbol.price - symbol.previous_price,
 			symbol.price / symbol.previous_price * 100 - 100);
-		if (y - *scroll >= h) {
-			bottom = 0;
-			break;
-		}
 	}
 
+	if (!portfolio_length()) return;
+	for (i = 0; i < w; i++)
+		tb_set_cell(i, rows + 1, ' ', TB_BLACK, TB_WHITE);
+	tb_print(COL_SYMBOL - 2, rows + 1, TB_BLACK, TB_WHITE, " Total");
+	portfolio_totals(&value, &day, &total);
+	draw_worth(w + COL_VALUE, rows + 1, value, 1, TB_WHITE);
+	draw_worth(w + COL_DAY, rows + 1, day, 0, TB_WHITE);
+	draw_worth(w + COL_TOTAL, rows + 1, total, 0, TB_WHITE);
+}
+
+static void open_chart(struct symbol *symbol) {
+	chart_reset();
+	pthread_mutex_lock(&view_lock);
+	chart_symbol = symbol;
+	chart_wanted = 1;
+	pthread_mutex_unlock(&view_lock);
+	fetch_wakeup();
+	mode = MODE_CHART;
+}
+
+static void open_options(struct symbol *symbol) {
+	options_reset();
+	options_scroll = 0;
+	pthread_mutex_lock(&view_lock);
+	options_symbol = symbol;
+	options_wanted = 1;
+	pthread_mutex_unlock(&view_lock);
+	fetch_wakeup();
+	mode = MODE_OPTIONS;
+}
+
+static void close_view() {
+	pthread_mutex_lock(&view_lock);
+	options_symbol = NULL;
+	pthread_mutex_unlock(&view_lock);
+	mode = MODE_LIST;
+}
+
+/* live fetch and frame statistics on the last line */
+static void draw_overlay() {
+
+	char latency[64], age[64], buf[320];
+	long now = now_ms(), oldest = -1, quotes = stats_counter(COUNT_QUOTES);
+	long p[PERCENTILES];
+	size_t i;
+	int x, y = tb_height() - 1;
+
+	if (now - rate_time >= 1000) {
+		quote_rate = rate_time ?
+			(quotes - rate_quotes) * 1000.0 / (now - rate_time) : 0;
+		rate_time = now;
+		rate_quotes = quotes;
+	}
+	for (i = 0; i < symbols_length; i++)
+		if (symbols[i].received && (oldest == -1 ||
+				symbols[i].received < oldest))
+			oldest = symbols[i].received;
+
+	if (!stats_percentiles(p))
+		sprintf(latency, "p50 %ld p95 %ld p99 %ld ms", p[0], p[1],
+			p[2]);
+	else strcpy(latency, "no latency yet");
+	if (!stats_age_percentiles(p))
+		sprintf(age, "age p50 %ld p95 %ld s", p[0], p[1]);
+	else strcpy(age, "age unknown");
+	snprintf(buf, sizeof(buf), " %.1f quotes/s | %ld in flight | %s | "
+		"reuse %.0f%% | %.1f MB in | frame %.2f ms %ld B | oldest %ld s"
+		" | %s", quote_rate, stats_counter(COUNT_PENDING), latency,
+		stats_reuse() * 100, stats_counter(COUNT_RECEIVED) / 1e6,
+		frame_time / 1000.0, frame_bytes,
+		oldest == -1 ? 0 : (now - oldest) / 1000, age);
+
+	for (x = 0; x < tb_width(); x++)
+		tb_set_cell(x, y, ' ', TB_BLACK, TB_CYAN);
+	tb_print(0, y, TB_BLACK, TB_CYAN, buf);
+}
+
+/* draw the current view to the terminal */
+static void frame(int *scroll) {
+
+	long start = now_us();
+	size_t written = tb_written();
+
+	trace_begin("build");
+	tb_clear();
+	if (mode == MODE_CHART)
+		draw_chart(chart_symbol->symbol, chart_symbol->name,
+				chart_symbol->history);
+	else if (mode == MODE_OPTIONS)
+		draw_options(options_symbol->symbol, options_scroll);
+	else if (mode == MODE_MOVERS)
+		draw_movers();
+	else
+		draw_list(scroll);
+	if (overlay) draw_overlay();
+	alerts_ring();
+	trace_end();
+	trace_begin("flush");
 	tb_present();
+	trace_end();
+	frame_time = now_us() - start;
+	frame_bytes = tb_written() - written;
+}
+
+int display(int *scroll) {
+
+	struct tb_event ev;
+	int h;
+
+	frame(scroll);
+	if (tb_peek_event(&ev, REFRESH)) return 0;
+	if (ev.key == TB_KEY_F12) {
+		overlay = !overlay;
+		return 0;
+	}
+
+	h = tb_height();
+	if (mode != MODE_LIST && (ev.key == TB_KEY_ESC || ev.ch == 'q')) {
+		close_view();
+		return 0;
+	}
+	if (mode == MODE_MOVERS) return 0;
+	if (mode == MODE_CHART) {
+		if (ev.ch == '+' || ev.ch == '=') chart_zoom(-1);
+		if (ev.ch == '-') chart_zoom(1);
+		return 0;
+	}
+	if (mode == MODE_OPTIONS) {
+		if ((ev.key == TB_KEY_ARROW_DOWN || ev.ch == 'j') &&
+				options_scroll + h - 2 < (int)options_length())
+			options_scroll++;
+		if ((ev.key == TB_KEY_ARROW_UP || ev.ch == 'k') &&
+				options_scroll)
+			options_scroll--;
+		return 0;
+	}
+
+	if (searching) {
+		if (ev.key == TB_KEY_ESC) search_clear();
+		if (ev.key == TB_KEY_ESC || ev.key == TB_KEY_ENTER)
+			searching = 0;
+		if (ev.key == TB_KEY_BACKSPACE || ev.key == TB_KEY_BACKSPACE2)
+			search_pop();
+		if (ev.ch) {
+			search_push(ev.ch);
+			cursor = *scroll = 0;
+		}
+		ev.ch = 0;
+		if (ev.key != TB_KEY_ARROW_DOWN && ev.key != TB_KEY_ARROW_UP)
+			return 0;
+	}
 
-	if (!tb_peek_event(&ev, REFRESH)) {
-		if (ev.key == TB_KEY_ESC || ev.ch == 'q') return -1;
-		if ((ev.key == TB_KEY_ARROW_DOWN || ev.ch == 'j') && !bottom)
-			(*scroll)++;
-		if ((ev.key == TB_KEY_ARROW_UP || ev.ch == 'k') && *scroll)
-			(*scroll)--;
+	if (ev.key == TB_KEY_ESC && *search_query()) {
+		search_clear();
+		return 0;
 	}
+	if (ev.key == TB_KEY_ESC || ev.ch == 'q') return -1;
+	if (ev.key == TB_KEY_ENTER && search_length())
+		open_chart(&symbols[search_row(cursor)]);
+	if (ev.ch == 'o' && search_length())
+		open_options(&symbols[search_row(cursor)]);
+	if (ev.ch == 'm') mode = MODE_MOVERS;
+	if (ev.ch == '/') searching = 1;
+	if (ev.ch == 's') sort_set((sort_column + 1) % SORTS, sort_reverse);
+	if (ev.ch == 'S') sort_set(sort_column, !sort_reverse);
+	if ((ev.key == TB_KEY_ARROW_DOWN || ev.ch == 'j') &&
+			cursor + 1 < (int)search_length())
+		cursor++;
+	if ((ev.key == TB_KEY_ARROW_UP || ev.ch == 'k') && cursor)
+		cursor--;
+	h = list_rows();
+	if (cursor < *scroll) *scroll = cursor;
+	if (cursor > *scroll + h - 1) *scroll = cursor - h + 1;
 	return 0;
 }
 
+const char str_stream_time[] = "{\"time\":";
+const char str_stream_symbol[] = "\"symbol\":\"";
+const char str_stream_price[] = "\"price\":";
+const char str_stream_old_price[] = "\"previous_close\":";
+const char str_stream_name[] = "\"name\":\"";
+
+/* apply a quote written by --headless, returns its time in ms or -1 */
+static long replay_line(char *line, size_t len) {
+
+	char buf[64], name[256];
+	double price, previous_price, t;
+	long i;
+
+	if (find_copy(line, str_stream_time, len, sizeof(str_stream_time),
+			',', buf, sizeof(buf)))
+		return -1;
+	t = atof(buf);
+	if (find_copy(line, str_stream_price, len, sizeof(str_stream_price),
+			',', buf, sizeof(buf)))
+		return -1;
+	price = atof(buf);
+	if (find_copy(line, str_stream_old_price, len,
+			sizeof(str_stream_old_price), ',', buf, sizeof(buf)))
+		return -1;
+	previous_price = atof(buf);
+	if (find_copy(line, str_stream_name, len, sizeof(str_stream_name),
+			'"', name, sizeof(name)))
+		return -1;
+	if (find_copy(line, str_stream_symbol, len, sizeof(str_stream_symbol),
+			'"', buf, sizeof(buf)) || (i = symbol_find(buf)) == -1)
+		return -1;
+
+	symbols[i].price = price;
+	symbols[i].previous_price = previous_price;
+	strlcpy(symbols[i].name, name, sizeof(symbols[i].name));
+	quoted(i, t);
+	return t * 1000;
+}
+
+/* bytes written to the terminal by render_bench() */
+long rendered = 0;
+
+static void *drain(void *ptr) {
+
+	char buf[1 << 16];
+	ssize_t len;
+
+	while ((len = read(*(int*)ptr, buf, sizeof(buf))) > 0) rendered += len;
+	return ptr;
+}
+
+/* end drain() by closing the terminal side, then close the other ends */
+static void close_pipes(pthread_t thread, int *in, int *out) {
+	close(out[1]);
+	pthread_join(thread, NULL);
+	close(out[0]);
+	close(in[0]);
+	close(in[1]);
+}
+
+/*
+ * Draw the list to a width x height terminal behind pipes while applying
+ * the quotes of a file written by --headless, a frame every REFRESH ms of
+ * quote time. Prints the frame rate, bytes and CPU time of a frame.
+ */
+static int render_bench(const char *path, int width, int height) {
+
+	char line[1024], reply[32];
+	int in[2], out[2], scroll = 0;
+	long t, shown = -1, frames = 0, wall = 0, cpu = 0, start, start_cpu;
+	pthread_t thread;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f) return -1;
+	if (pipe(in)) {
+		fclose(f);
+		return -1;
+	}
+	if (pipe(out)) {
+		close(in[0]);
+		close(in[1]);
+		fclose(f);
+		return -1;
+	}
+	/* the size query of tb_init_rwfd() finds its answer waiting */
+	sprintf(reply, "\x1b[%d;%dR", height, width);
+	write(in[1], reply, strlen(reply));
+	if (pthread_create(&thread, NULL, drain, &out[0])) {
+		close(out[0]);
+		close(out[1]);
+		close(in[0]);
+		close(in[1]);
+		fclose(f);
+		return -1;
+	}
+	if (tb_init_rwfd(in[0], out[1])) {
+		close_pipes(thread, in, out);
+		fclose(f);
+		return -1;
+	}
+
+	for (;;) {
+		t = fgets(line, sizeof(line), f) ? replay_line(line,
+			strlen(line)) : -2;
+		if (t == -1) continue;
+		if (shown == -1) shown = t;
+		if (t != -2 && t - shown < REFRESH) continue;
+
+		start = now_us();
+		start_cpu = cpu_us();
+		frame(&scroll);
+		wall += now_us() - start;
+		cpu += cpu_us() - start_cpu;
+		frames++;
+		shown = t;
+		if (t == -2) break;
+	}
+
+	tb_shutdown();
+	close_pipes(thread, in, out);
+	fclose(f);
+
+	printf("%lu symbols on %dx%d: %ld frames, %.0f frames/s, %ld bytes "
+		"and %ld us of CPU per frame\n", (unsigned long)symbols_length,
+		width, height, frames, wall ? frames * 1e6 / wall : 0.0,
+		rendered / frames, cpu / frames);
+	return 0;
+}
+
+#define PARSE_TIME 200000 /* us spent at least on each extractor */
+
+/* quote parsed by parse_bench() */
+struct symbol parsed;
+
+static int parse_quote(const char *data, size_t len) {
+	return parse_symbol(&parsed, data, len);
+}
+
+/* occurrences of needle in data */
+static size_t count(const char *data, size_t len, const char *needle) {
+
+	const char *p = data, *end = data + len;
+	size_t ret = 0;
+
+	while ((p = strnstr(p, needle, end - p))) {
+		p += strlen(needle);
+		ret++;
+	}
+	return ret;
+}
+
+/*
+ * Time parse on data, doubling the runs until it takes PARSE_TIME. The
+ * throughput is only meaningful for parsers reading the whole response.
+ */
+static void parse_time(const char *path, const char *name,
+		int (*parse)(const char *, size_t), const char *data,
+		size_t len, size_t fields, int whole) {
+
+	char rate[32];
+	long runs, i, start, elapsed;
+
+	for (runs = 1;; runs *= 2) {
+		start = now_us();
+		for (i = 0; i < runs; i++) parse(data, len);
+		elapsed = now_us() - start;
+		if (elapsed >= PARSE_TIME) break;
+	}
+	if (whole) sprintf(rate, "%8.1f", (double)len * runs / elapsed);
+	else strcpy(rate, "       -");
+	printf("%-24s %-8s %8lu bytes %6lu fields %s MB/s %8.1f ns/field\n",
+		path, name, (unsigned long)len, (unsigned long)fields, rate,
+		elapsed * 1000.0 / runs / fields);
+}
+
+/*
+ * Benchmark the extractors on a saved response: the quote and the option
+ * chain of an options response, the bars of a chart response.
+ */
+static int parse_bench(const char *path) {
+
+	const char *p, *end, *name;
+	size_t len, fields;
+	char *data;
+
+	data = replay_file(path, &len);
+	if (!data) return -1;
+	name = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+
+	if (!parse_quote(data, len))
+		parse_time(name, "quote", parse_quote, data, len, 5, 0);
+	fields = count(data, len, "\"strike\":") * 5;
+	if (fields)
+		parse_time(name, "options", options_parse, data, len,
+			fields + 1, 1);
+	p = strnstr(data, "\"timestamp\":[", len);
+	end = p ? strchr(p, ']') : NULL;
+	if (end && end != p + 13) {
+		fields = (count(p, end - p, ",") + 1) * 5;
+		parse_time(name, "chart", chart_parse, data, len, fields, 1);
+	}
+
+	options_reset();
+	chart_reset();
+	free(data);
+	return 0;
+}
+
+/* print the ticks of a journal file as CSV rows */
+static int dump_journal(const char *path) {
+
+	struct journal j;
+	const struct journal_record *r;
+	const char *name;
+	size_t i;
+
+	if (journal_map(&j, path)) return -1;
+	printf("time,symbol,price,previous_close\n");
+	for (i = 1; i < j.length; i++) {
+		r = &j.records[i];
+		if (r->type != JOURNAL_TICK) continue;
+		name = journal_name(&j, r->id);
+		printf("%lu.%03lu,%.*s,%.9g,%.9g\n",
+			(unsigned long)r->u.tick.time,
+			(unsigned long)r->u.tick.msec,
+			(int)sizeof(r->u.symbol), name ? name : "?",
+			r->u.tick.price, r->u.tick.previous_price);
+	}
+	journal_unmap(&j);
+	return 0;
+}
+
+static void free_symbols() {
+
+	size_t i;
+
+	for (i = 0; i < symbols_length; i++) history_free(symbols[i].history);
+	free(symbols);
+	sort_free();
+	movers_free();
+	search_free();
+	alerts_free();
+	portfolio_free();
+	free(view);
+}
+
+static void usage(const char *name) {
+	printf("usage: %s [--daemon] [--bus name] [--headless [--csv] "
+		"[-o file]]\n\t[--listen socket] [--record dir | --replay dir "
+		"[--latency ms] [--jitter ms]\n\t[--jitter-dist "
+		"exponential|uniform|normal]]\n\t[--server url] "
+		"[--bench cycles]\n\t[--render quotes [--size colsxrows]] "
+		"[--parse response]\n\t[--trace file] [--dump journal]\n",
+		name);
+}
+
 int main(int argc, char *argv[]) {
 
-	int scroll = 0, run;
+	int scroll = 0, headless = 0, daemon = 0, format = STREAM_JSON, sig;
+	size_t i;
+	char path[PATH_MAX], *output = NULL, *socket = NULL;
+	char *record = NULL, *replay = NULL, *render = NULL, *parse = NULL;
+	char *trace = NULL, *dump = NULL, *bus_path = NULL, *dist = NULL;
+	long latency = 0, jitter = 0, p[PERCENTILES];
+	int distribution = JITTER_EXPONENTIAL;
 	pthread_t thread;
+	sigset_t signals;
+	struct rusage resources;
+	long elapsed = 0, quotes;
+	double cpu;
+	int width = 80, height = 24;
+
+	for (i = 1; i < (size_t)argc; i++) {
+		if (!strcmp(argv[i], "--headless")) headless = 1;
+		else if (!strcmp(argv[i], "--daemon")) daemon = 1;
+		else if (!strcmp(argv[i], "--listen") && i + 1 < (size_t)argc)
+			socket = argv[++i];
+		else if (!strcmp(argv[i], "--record") && i + 1 < (size_t)argc)
+			record = argv[++i];
+		else if (!strcmp(argv[i], "--replay") && i + 1 < (size_t)argc)
+			replay = argv[++i];
+		else if (!strcmp(argv[i], "--latency") && i + 1 < (size_t)argc)
+			latency = atol(argv[++i]);
+		else if (!strcmp(argv[i], "--jitter") && i + 1 < (size_t)argc)
+			jitter = atol(argv[++i]);
+		else if (!strcmp(argv[i], "--jitter-dist") &&
+				i + 1 < (size_t)argc)
+			dist = argv[++i];
+		else if (!strcmp(argv[i], "--server") && i + 1 < (size_t)argc)
+			server = argv[++i];
+		else if (!strcmp(argv[i], "--bench") && i + 1 < (size_t)argc)
+			bench = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--render") && i + 1 < (size_t)argc)
+			render = argv[++i];
+		else if (!strcmp(argv[i], "--trace") && i + 1 < (size_t)argc)
+			trace = argv[++i];
+		else if (!strcmp(argv[i], "--parse") && i + 1 < (size_t)argc)
+			parse = argv[++i];
+		else if (!strcmp(argv[i], "--bus") && i + 1 < (size_t)argc)
+			bus_path = argv[++i];
+		else if (!strcmp(argv[i], "--dump") && i + 1 < (size_t)argc)
+			dump = argv[++i];
+		else if (!strcmp(argv[i], "--size") && i + 1 < (size_t)argc)
+			sscanf(argv[++i], "%dx%d", &width, &height);
+		else if (!strcmp(argv[i], "--csv")) format = STREAM_CSV;
+		else if (!strcmp(argv[i], "-o") && i + 1 < (size_t)argc)
+			output = argv[++i];
+		else {
+			usage(argv[0]);
+			return -1;
+		}
+	}
+
+	if (dist && !strcmp(dist, "uniform")) distribution = JITTER_UNIFORM;
+	else if (dist && !strcmp(dist, "normal")) distribution = JITTER_NORMAL;
+	else if (dist && strcmp(dist, "exponential")) {
+		usage(argv[0]);
+		return -1;
+	}
+	if (bus_path && bus_name(bus_path)) {
+		printf("invalid bus name %s\n", bus_path);
+		return -1;
+	}
+
+	/* before anything else is written to stdout, which it may buffer */
+	if (headless && stream_open(output, format)) {
+		printf("cannot open %s: %s\n", output, strerror(errno));
+		return -1;
+	}
+
+	if (parse) {
+		if (!parse_bench(parse)) return 0;
+		printf("cannot read %s: %s\n", parse, strerror(errno));
+		return -1;
+	}
+	if (dump) {
+		if (!dump_journal(dump)) return 0;
+		fprintf(stderr, "cannot read %s: %s\n", dump,
+			strerror(errno));
+		return -1;
+	}
 
-	if (!argc) return sizeof(*argv);
+	if (trace && trace_open(trace)) {
+		printf("cannot trace to %s: %s\n", trace, strerror(errno));
+		return -1;
+	}
+	trace_thread("ui");
 
 	if (load_symbols()) {
 		printf("cannot find symbols file\n");
 		return -1;
 	}
 
-	curl_global_init(CURL_GLOBAL_ALL);
+	if (sort_init() || movers_init() || search_init()) {
+		printf(alloc_fail);
+		return -1;
+	}
+
+	config_path(path, sizeof(path), "alerts");
+	if (alerts_load(path)) {
+		printf(alloc_fail);
+		return -1;
+	}
+	config_path(path, sizeof(path), "positions");
+	if (portfolio_load(path)) {
+		printf(alloc_fail);
+		return -1;
+	}
+	if (render) {
+		if (render_bench(render, width, height))
+			printf("cannot render %s: %s\n", render,
+				strerror(errno));
+		symbol_find_free();
+		free_symbols();
+		trace_close();
+		return 0;
+	}
+	if (daemon && bus_create()) {
+		printf("cannot publish quotes: %s\n", strerror(errno));
+		return -1;
+	}
+	if (!daemon) bus_attach();
+	symbol_find_free();
+
+	config_path(path, sizeof(path), "journal");
+	journal_open(path);
+
+	if (!bench && (headless || daemon)) {
+		/*
+		 * run until interrupted, without a terminal. Blocked before
+		 * any thread is started so that only sigwait() takes them.
+		 */
+		sigemptyset(&signals);
+		sigaddset(&signals, SIGINT);
+		sigaddset(&signals, SIGTERM);
+		pthread_sigmask(SIG_BLOCK, &signals, NULL);
+	}
+	replay_init(record, replay, latency, jitter, distribution);
+	if (fetch_init()) {
+		printf("cannot initialize libcurl\n");
+		return -1;
+	}
 
-	if (tb_init()) {
+	if (socket && server_start(socket)) {
+		printf("cannot listen on %s: %s\n", socket, strerror(errno));
+		return -1;
+	}
+	if (bench) {
+		/* requests are only limited by the server */
+		limit_disable();
+	} else if (!headless && !daemon && tb_init()) {
 		printf("tb_init: %s\n", strerror(errno));
 		return -1;
 	}
 
 	run = 1;
-	pthread_create(&thread, NULL, update_thread, &run);
-
-	while (!display(&scroll)) ;
-
-	run = 0;
-	tb_shutdown();
-	pthread_join(thread, NULL);
-	curl_global_cleanup();
-	free(symbols);
+	start_time = now_ms();
+	bus_poll(update_bus); /* start with the quotes of a daemon, if any */
+	pthread_create(&thread, NULL, update_thread, NULL);
+
+	if (bench) {
+		pthread_join(thread, NULL);
+		elapsed = now_ms() - start_time;
+	} else {
+		if (headless || daemon) sigwait(&signals, &sig);
+		else while (!display(&scroll)) ;
+		stop();
+		if (!headless && !daemon) tb_shutdown();
+		pthread_join(thread, NULL);
+	}
+	server_stop();
+	fetch_cleanup();
+	journal_close();
+	stream_close();
+	bus_close();
+	trace_close();
+	free_symbols();
+
+	if (bench) {
+		getrusage(RUSAGE_SELF, &resources);
+		cpu = (resources.ru_utime.tv_sec + resources.ru_stime.tv_sec) *
+			1e6 + resources.ru_utime.tv_usec +
+			resources.ru_stime.tv_usec;
+		quotes = stats_counter(COUNT_QUOTES);
+		printf("%ld quotes in %ld ms, %.0f requests/s, %.0f us of CPU "
+			"per quote\n", quotes, elapsed,
+			elapsed ? quotes * 1000.0 / elapsed : 0.0,
+			quotes ? cpu / quotes : 0.0);
+		stats_histograms();
+	}
+	if (headless || daemon) return 0;
+	if (first_screen != -1 && !bench)
+		printf("first screen loaded in %ld ms\n", first_screen);
+	if (!stats_percentiles(p)) {
+		printf("fetch latency p50 %ld ms, p95 %ld ms, p99 %ld ms\n",
+			p[0], p[1], p[2]);
+		printf("%.1f requests per connection\n", stats_streams());
+	}
+	if (!stats_age_percentiles(p))
+		printf("quote age p50 %ld s, p95 %ld s, p99 %ld s\n",
+			p[0], p[1], p[2]);
 
 	return 0;
 }
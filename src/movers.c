@@ -0,0 +1,182 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include "termbox.h"
+#include "symbol.h"
+#include "movers.h"
+
+#define NONE ((size_t)-1)
+
+/* binary heap of symbol indices with the position of each symbol in it */
+struct heap {
+	size_t *items;
+	size_t *position;
+	size_t length;
+	int sign; /* 1 for highest percent change first, -1 for lowest */
+};
+
+/* updated by the fetcher, read by the UI */
+static pthread_mutex_t movers_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct heap gainers, losers;
+static float *percent = NULL;
+
+static int before(const struct heap *h, size_t a, size_t b) {
+	return h->sign > 0 ? percent[a] > percent[b] : percent[a] < percent[b];
+}
+
+static void swap(struct heap *h, size_t a, size_t b) {
+
+	size_t tmp = h->items[a];
+
+	h->items[a] = h->items[b];
+	h->items[b] = tmp;
+	h->position[h->items[a]] = a;
+	h->position[h->items[b]] = b;
+}
+
+static void sift_up(struct heap *h, size_t i) {
+	while (i && before(h, h->items[i], h->items[(i - 1) / 2])) {
+		swap(h, i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+static void sift_down(struct heap *h, size_t i) {
+
+	size_t child;
+
+	for (;;) {
+		child = 2 * i + 1;
+		if (child >= h->length) break;
+		if (child + 1 < h->length &&
+				before(h, h->items[child + 1], h->items[child]))
+			child++;
+		if (!before(h, h->items[child], h->items[i])) break;
+		swap(h, i, child);
+		i = child;
+	}
+}
+
+/* insert symbol i or move it after its key changed */
+static void heap_update(struct heap *h, size_t i) {
+
+	if (h->position[i] == NONE) {
+		h->items[h->length] = i;
+		h->position[i] = h->length++;
+	}
+	sift_up(h, h->position[i]);
+	sift_down(h, h->position[i]);
+}
+
+static int heap_init(struct heap *h, int sign) {
+
+	size_t i;
+
+	h->items = malloc(symbols_length * sizeof(*h->items));
+	h->position = malloc(symbols_length * sizeof(*h->position));
+	if (symbols_length && (!h->items || !h->position)) return -1;
+	for (i = 0; i < symbols_length; i++) h->position[i] = NONE;
+	h->length = 0;
+	h->sign = sign;
+	return 0;
+}
+
+int movers_init() {
+	percent = malloc(symbols_length * sizeof(*percent));
+	if (symbols_length && !percent) return -1;
+	if (heap_init(&gainers, 1) || heap_init(&losers, -1)) return -1;
+	return 0;
+}
+
+void movers_free() {
+	free(gainers.items);
+	free(gainers.position);
+	free(losers.items);
+	free(losers.position);
+	free(percent);
+}
+
+/* reorder both heaps after a quote of symbol i, in O(log n) */
+void movers_update(size_t i) {
+
+	const struct symbol *s = &symbols[i];
+
+	if (!s->previous_price) return;
+	pthread_mutex_lock(&movers_lock);
+	percent[i] = s->price / s->previous_price * 100 - 100;
+	heap_update(&gainers, i);
+	heap_update(&losers, i);
+	pthread_mutex_unlock(&movers_lock);
+}
+
+/*
+ * Copy the n first symbols of a heap into out, best first. The frontier of
+ * nodes to visit never exceeds n + 1 entries, so this is O(n^2) in the
+ * worst case whatever the number of symbols.
+ */
+size_t movers_top(int best, size_t *out, size_t n) {
+
+	struct heap *h = best ? &gainers : &losers;
+	size_t *frontier, length = 0, count = 0, i, pick, node;
+
+	frontier = malloc((n + 1) * sizeof(*frontier));
+	if (!frontier) return 0;
+
+	pthread_mutex_lock(&movers_lock);
+	if (h->length && n) frontier[length++] = 0;
+	while (length && count < n) {
+		pick = 0;
+		for (i = 1; i < length; i++)
+			if (before(h, h->items[frontier[i]],
+					h->items[frontier[pick]]))
+				pick = i;
+		node = frontier[pick];
+		frontier[pick] = frontier[--length];
+		out[count++] = h->items[node];
+		if (2 * node + 1 < h->length) frontier[length++] = 2 * node + 1;
+		if (2 * node + 2 < h->length) frontier[length++] = 2 * node + 2;
+	}
+	pthread_mutex_unlock(&movers_lock);
+
+	free(frontier);
+	return count;
+}
+
+static void draw_side(int x, int width, int top, int rows, int best) {
+
+	const struct symbol *s;
+	size_t *rank, length, i;
+
+	rank = malloc(rows * sizeof(*rank));
+	if (!rank) return;
+	length = movers_top(best, rank, rows);
+	for (i = 0; i < length; i++) {
+		s = &symbols[rank[i]];
+		tb_print(x + 1, top + i, TB_DEFAULT, TB_DEFAULT, s->symbol);
+		tb_printf(x + width - 22, top + i, TB_DEFAULT, TB_DEFAULT,
+			"%10.2f", s->price);
+		tb_printf(x + width - 11, top + i, best ? TB_GREEN : TB_RED,
+			TB_DEFAULT, "%+9.2f%%",
+			s->price / s->previous_price * 100 - 100);
+	}
+	free(rank);
+}
+
+/* gainers on the left half of the screen, losers on the right one */
+void draw_movers() {
+
+	int i, w, h;
+
+	w = tb_width();
+	h = tb_height();
+	if (h < 3) return;
+
+	for (i = 0; i < w; i++) tb_set_cell(i, 0, ' ', TB_BLACK, TB_WHITE);
+	tb_print(0, 0, TB_BLACK, TB_WHITE, " Top gainers");
+	tb_print(w / 2, 0, TB_BLACK, TB_WHITE, "| Top losers");
+	tb_print(w - sizeof("esc back"), 0, TB_BLACK, TB_WHITE, "esc back");
+
+	draw_side(0, w / 2, 1, h - 1, 1);
+	draw_side(w / 2, w - w / 2, 1, h - 1, 0);
+}
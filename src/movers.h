@@ -0,0 +1,5 @@
+int movers_init(void);
+void movers_free(void);
+void movers_update(size_t i);
+size_t movers_top(int gainers, size_t *out, size_t n);
+void draw_movers(void);
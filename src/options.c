@@ -0,0 +1,263 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "termbox.h"
+#include "strnstr.h"
+#include "options.h"
+
+#define CALL_OI 0
+#define CALL_IV 1
+#define CALL_BID 2
+#define CALL_ASK 3
+#define STRIKE 4
+#define PUT_BID 5
+#define PUT_ASK 6
+#define PUT_IV 7
+#define PUT_OI 8
+#define COLUMNS 9
+#define CELL 10 /* width of a column */
+
+static const char *headers[COLUMNS] = {
+	"Open int", "IV", "Bid", "Ask", "Strike", "Bid", "Ask", "IV", "Open int"
+};
+
+/*
+ * Option chain of one expiration as a columnar table, one row per strike,
+ * -1 for a missing contract. changed flags the cells modified by the last
+ * refresh, one bit per column.
+ */
+struct table {
+	size_t length, capacity;
+	float *columns[COLUMNS];
+	uint16_t *changed;
+	uint32_t expiration;
+};
+
+/* written by the fetcher, read by the UI */
+static pthread_mutex_t options_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct table options;
+
+struct contract {
+	float strike, bid, ask, iv, oi;
+};
+
+static void table_free(struct table *t) {
+
+	size_t i;
+
+	for (i = 0; i < COLUMNS; i++) free(t->columns[i]);
+	free(t->changed);
+	memset(t, 0, sizeof(*t));
+}
+
+static int table_grow(struct table *t, size_t capacity) {
+
+	void *p;
+	size_t i;
+
+	if (capacity <= t->capacity) return 0;
+	for (i = 0; i < COLUMNS; i++) {
+		p = realloc(t->columns[i], capacity * sizeof(float));
+		if (!p) return -1;
+		t->columns[i] = p;
+	}
+	p = realloc(t->changed, capacity * sizeof(*t->changed));
+	if (!p) return -1;
+	t->changed = p;
+	t->capacity = capacity;
+	return 0;
+}
+
+void options_reset() {
+	pthread_mutex_lock(&options_lock);
+	table_free(&options);
+	pthread_mutex_unlock(&options_lock);
+}
+
+size_t options_length() {
+
+	size_t ret;
+
+	pthread_mutex_lock(&options_lock);
+	ret = options.length;
+	pthread_mutex_unlock(&options_lock);
+	return ret;
+}
+
+static float field(const char *start, const char *end, const char *key) {
+
+	const char *p;
+
+	p = strnstr(start, key, end - start);
+	if (!p) return -1;
+	return strtod(p + strlen(key), NULL);
+}
+
+/* parse the flat contract objects of the array following key */
+static size_t parse_side(const char *data, size_t len, const char *key,
+			struct contract **out) {
+
+	const char *p, *end, *close;
+	struct contract *c = NULL, *tmp;
+	size_t length = 0, capacity = 0;
+
+	*out = NULL;
+	p = strnstr(data, key, len);
+	if (!p) return 0;
+	p += strlen(key);
+	end = data + len;
+
+	while (p < end && *p == '{') {
+		close = memchr(p, '}', end - p);
+		if (!close) break;
+		if (length == capacity) {
+			capacity = capacity ? capacity * 2 : 64;
+			tmp = realloc(c, capacity * sizeof(*c));
+			if (!tmp) break;
+			c = tmp;
+		}
+		c[length].strike = field(p, close, "\"strike\":");
+		c[length].bid = field(p, close, "\"bid\":");
+		c[length].ask = field(p, close, "\"ask\":");
+		c[length].iv = field(p, close, "\"impliedVolatility\":");
+		c[length].oi = field(p, close, "\"openInterest\":");
+		if (c[length].strike >= 0) length++;
+		p = close + 1;
+		if (p < end && *p == ',') p++;
+	}
+	*out = c;
+	return length;
+}
+
+/* write a row, only rewriting and flagging the changed cells when keep */
+static void set_row(struct table *t, size_t row, const struct contract *call,
+			const struct contract *put, int keep) {
+
+	float values[COLUMNS];
+	size_t i;
+
+	values[STRIKE] = call ? call->strike : put->strike;
+	values[CALL_OI] = call ? call->oi : -1;
+	values[CALL_IV] = call ? call->iv : -1;
+	values[CALL_BID] = call ? call->bid : -1;
+	values[CALL_ASK] = call ? call->ask : -1;
+	values[PUT_BID] = put ? put->bid : -1;
+	values[PUT_ASK] = put ? put->ask : -1;
+	values[PUT_IV] = put ? put->iv : -1;
+	values[PUT_OI] = put ? put->oi : -1;
+
+	t->changed[row] = 0;
+	for (i = 0; i < COLUMNS; i++) {
+		if (keep && t->columns[i][row] == values[i]) continue;
+		t->columns[i][row] = values[i];
+		if (keep) t->changed[row] |= 1 << i;
+	}
+}
+
+/*
+ * Load the option chain of a v7/finance/options response. While the strikes
+ * match the previous chain, only the cells that differ are rewritten and
+ * flagged as changed.
+ */
+int options_parse(const char *data, size_t len) {
+
+	struct contract *calls, *puts;
+	size_t ncalls, nputs, i, j, row;
+	const char *p;
+	float strike;
+	int keep;
+
+	ncalls = parse_side(data, len, "\"calls\":[", &calls);
+	nputs = parse_side(data, len, "\"puts\":[", &puts);
+
+	pthread_mutex_lock(&options_lock);
+	if (table_grow(&options, ncalls + nputs)) {
+		pthread_mutex_unlock(&options_lock);
+		free(calls);
+		free(puts);
+		return -1;
+	}
+
+	/* merge both sides, sorted by strike, into rows */
+	keep = 1;
+	for (i = j = row = 0; i < ncalls || j < nputs; row++) {
+		const struct contract *call = NULL, *put = NULL;
+		if (i < ncalls && (j >= nputs || calls[i].strike <= puts[j].strike))
+			call = &calls[i++];
+		if (j < nputs && (!call || puts[j].strike == call->strike))
+			put = &puts[j++];
+		strike = call ? call->strike : put->strike;
+		if (row >= options.length ||
+				options.columns[STRIKE][row] != strike)
+			keep = 0;
+		set_row(&options, row, call, put, keep);
+	}
+	options.length = row;
+
+	p = strnstr(data, "\"expirationDate\":", len);
+	if (p) options.expiration = strtoul(p + 17, NULL, 10);
+	pthread_mutex_unlock(&options_lock);
+
+	free(calls);
+	free(puts);
+	return 0;
+}
+
+static void draw_cell(int x, int y, float value, int column, int changed) {
+
+	uintattr_t fg = changed ? TB_BLACK : TB_DEFAULT;
+	uintattr_t bg = changed ? TB_YELLOW : TB_DEFAULT;
+
+	if (value < 0) return;
+	if (column == CALL_IV || column == PUT_IV)
+		tb_printf(x, y, fg, bg, "%*.1f%%", CELL - 2, value * 100);
+	else if (column == CALL_OI || column == PUT_OI)
+		tb_printf(x, y, fg, bg, "%*.0f", CELL - 1, value);
+	else if (column == STRIKE)
+		tb_printf(x, y, fg | TB_BOLD, bg, "%*.2f", CELL - 1, value);
+	else
+		tb_printf(x, y, fg, bg, "%*.2f", CELL - 1, value);
+}
+
+/* draw the rows of the chain visible from scroll, changed cells highlighted */
+void draw_options(const char *symbol, int scroll) {
+
+	char date[32] = "";
+	struct tm tm;
+	time_t expiration;
+	size_t row;
+	int i, w, h, y;
+
+	w = tb_width();
+	h = tb_height();
+
+	for (i = 0; i < w; i++) {
+		tb_set_cell(i, 0, ' ', TB_BLACK, TB_WHITE);
+		tb_set_cell(i, 1, ' ', TB_BLACK, TB_WHITE);
+	}
+
+	pthread_mutex_lock(&options_lock);
+	expiration = options.expiration;
+	if (expiration)
+		strftime(date, sizeof(date), "%Y-%m-%d",
+			gmtime_r(&expiration, &tm));
+	tb_printf(0, 0, TB_BLACK, TB_WHITE, " %s options %s | calls | puts",
+		symbol, date);
+	tb_print(w - sizeof("j/k scroll, esc back"), 0, TB_BLACK, TB_WHITE,
+		"j/k scroll, esc back");
+	for (i = 0; i < COLUMNS; i++)
+		tb_printf(i * CELL, 1, TB_BLACK, TB_WHITE, "%*s", CELL - 1,
+			headers[i]);
+
+	if (!options.length)
+		tb_print(1, 2, TB_DEFAULT, TB_DEFAULT, "loading...");
+
+	for (y = 2, row = scroll; row < options.length && y < h; row++, y++) {
+		for (i = 0; i < COLUMNS && (i + 1) * CELL <= w; i++)
+			draw_cell(i * CELL, y, options.columns[i][row], i,
+				options.changed[row] & (1 << i));
+	}
+	pthread_mutex_unlock(&options_lock);
+}
@@ -0,0 +1,4 @@
+void options_reset(void);
+int options_parse(const char *data, size_t len);
+size_t options_length(void);
+void draw_options(const char *symbol, int scroll);
@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "symbol.h"
+#include "portfolio.h"
+
+/* what a position adds to the totals */
+struct worth {
+	double value, day, total;
+};
+
+struct position {
+	double quantity, cost; /* cost is the price paid per unit */
+	struct worth applied; /* part of the totals from the last quote */
+	int quoted;
+};
+
+/*
+ * Positions by symbol index, NULL without a positions file. Each quote
+ * replaces the worth its position last added to the totals, so the
+ * footer never sums the table.
+ */
+static struct position *positions = NULL;
+static size_t positions_length = 0;
+
+static pthread_mutex_t portfolio_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct worth totals;
+
+/*
+ * Load the positions file, one position per line: SYMBOL QUANTITY COST.
+ * Lines of the same symbol add up, at their average cost.
+ */
+int portfolio_load(const char *path) {
+
+	FILE *f;
+	char line[256], symbol[16];
+	double quantity, cost;
+	struct position *p;
+	long i;
+	int number = 0;
+
+	f = fopen(path, "r");
+	if (!f) return 0;
+
+	positions = calloc(symbols_length, sizeof(*positions));
+	if (symbols_length && !positions) {
+		fclose(f);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		number++;
+		if (line[0] == '#' || line[0] == '\n') continue;
+		if (sscanf(line, "%15s %lf %lf", symbol, &quantity, &cost) != 3 ||
+				(i = symbol_find(symbol)) == -1) {
+			fprintf(stderr, "%s:%d: ignored position\n", path,
+				number);
+			continue;
+		}
+		p = &positions[i];
+		if (p->quantity + quantity)
+			p->cost = (p->cost * p->quantity + cost * quantity) /
+				(p->quantity + quantity);
+		p->quantity += quantity;
+	}
+	fclose(f);
+
+	/* once all lines are added, some may have netted to nothing */
+	for (i = 0; i < (long)symbols_length; i++)
+		if (positions[i].quantity) positions_length++;
+	return 0;
+}
+
+void portfolio_free() {
+	free(positions);
+}
+
+/* number of symbols held, 0 hides the portfolio columns */
+size_t portfolio_length() {
+	return positions_length;
+}
+
+static void worth(size_t i, struct worth *w) {
+
+	const struct symbol *s = &symbols[i];
+	const struct position *p = &positions[i];
+
+	w->value = p->quantity * s->price;
+	w->day = p->quantity * (s->price - s->previous_price);
+	w->total = p->quantity * (s->price - p->cost);
+}
+
+/* apply the change of symbol i to the totals, from the fetcher thread */
+void portfolio_update(size_t i) {
+
+	struct worth w;
+	struct position *p;
+
+	if (!positions || !positions[i].quantity) return;
+	p = &positions[i];
+	worth(i, &w);
+
+	pthread_mutex_lock(&portfolio_lock);
+	totals.value += w.value - p->applied.value;
+	totals.day += w.day - p->applied.day;
+	totals.total += w.total - p->applied.total;
+	p->applied = w;
+	p->quoted = 1;
+	pthread_mutex_unlock(&portfolio_lock);
+}
+
+/* worth of the position in symbol i, -1 if none or not quoted yet */
+int portfolio_position(size_t i, double *value, double *day, double *total) {
+
+	struct worth w;
+	int ret = -1;
+
+	if (!positions || !positions[i].quantity) return -1;
+	pthread_mutex_lock(&portfolio_lock);
+	if (positions[i].quoted) {
+		w = positions[i].applied;
+		ret = 0;
+	}
+	pthread_mutex_unlock(&portfolio_lock);
+	if (ret) return ret;
+
+	*value = w.value;
+	*day = w.day;
+	*total = w.total;
+	return 0;
+}
+
+void portfolio_totals(double *value, double *day, double *total) {
+	pthread_mutex_lock(&portfolio_lock);
+	*value = totals.value;
+	*day = totals.day;
+	*total = totals.total;
+	pthread_mutex_unlock(&portfolio_lock);
+}
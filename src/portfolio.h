@@ -0,0 +1,6 @@
+int portfolio_load(const char *path);
+void portfolio_free(void);
+size_t portfolio_length(void);
+void portfolio_update(size_t i);
+int portfolio_position(size_t i, double *value, double *day, double *total);
+void portfolio_totals(double *value, double *day, double *total);
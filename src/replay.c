@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "strlcpy.h"
+#include "replay.h"
+
+/*
+ * Responses saved to a directory by --record, one file per URL, and served
+ * back by --replay instead of the network. Replayed responses arrive after
+ * a fixed latency plus a jitter of the given mean, exponentially, uniformly
+ * or normally distributed, drawn from a generator with a fixed seed so runs
+ * are reproducible.
+ */
+static char record_dir[1024], replay_dir[1024];
+static long replay_latency = 0, replay_jitter = 0;
+static int replay_distribution = JITTER_EXPONENTIAL;
+static unsigned long seed = 1;
+
+void replay_init(const char *record, const char *replay, long latency,
+		long jitter, int distribution) {
+	if (record) strlcpy(record_dir, record, sizeof(record_dir));
+	if (replay) strlcpy(replay_dir, replay, sizeof(replay_dir));
+	replay_latency = latency;
+	replay_jitter = jitter;
+	replay_distribution = distribution;
+}
+
+int replaying() {
+	return *replay_dir != '\0';
+}
+
+/* file of url in dir: the url with its punctuation replaced, and a hash */
+static void path(char *buf, size_t length, const char *dir, const char *url) {
+
+	char name[161];
+	unsigned long hash = 2166136261UL;
+	const char *p;
+	size_t i;
+
+	for (p = url; *p; p++) hash = ((hash ^ (unsigned char)*p) * 16777619UL)
+		& 0xffffffffUL;
+	for (p = strstr(url, "://") ? strstr(url, "://") + 3 : url, i = 0;
+			*p && i < sizeof(name) - 1; p++, i++)
+		name[i] = (*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') ||
+			(*p >= '0' && *p <= '9') || *p == '.' || *p == '-' ?
+			*p : '_';
+	name[i] = '\0';
+	snprintf(buf, length, "%s/%s-%08lx", dir, name, hash);
+}
+
+/* save the body of a response when recording */
+void replay_save(const char *url, const char *data, size_t len) {
+
+	char file[2048];
+	FILE *f;
+
+	if (!*record_dir) return;
+	path(file, sizeof(file), record_dir, url);
+	f = fopen(file, "w");
+	if (!f) return;
+	fwrite(data, 1, len, f);
+	fclose(f);
+}
+
+/* body saved in file, NUL terminated, NULL if it cannot be read */
+char *replay_file(const char *file, size_t *len) {
+
+	char *data;
+	long size;
+	FILE *f;
+
+	f = fopen(file, "r");
+	if (!f) return NULL;
+	if (fseek(f, 0, SEEK_END) || (size = ftell(f)) < 0 ||
+			fseek(f, 0, SEEK_SET)) {
+		fclose(f);
+		return NULL;
+	}
+	data = malloc(size + 1);
+	if (data && fread(data, 1, size, f) != (size_t)size) {
+		free(data);
+		data = NULL;
+	}
+	fclose(f);
+	if (!data) return NULL;
+	data[size] = '\0';
+	*len = size;
+	return data;
+}
+
+/* recorded body of url, NULL if it was not recorded */
+char *replay_load(const char *url, size_t *len) {
+
+	char file[2048];
+
+	path(file, sizeof(file), replay_dir, url);
+	return replay_file(file, len);
+}
+
+/* uniform in (0, 1] */
+static double uniform() {
+	seed = (seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+	return (seed + 1.0) / 2147483649.0;
+}
+
+/* milliseconds before a replayed response arrives */
+long replay_delay() {
+
+	double jitter, u;
+
+	switch (replay_distribution) {
+	case JITTER_UNIFORM: /* in [0, 2 * mean) */
+		jitter = 2 * (1 - uniform()) * replay_jitter;
+		break;
+	case JITTER_NORMAL:
+		/* standard deviation of half the mean, by Box-Muller */
+		u = uniform();
+		jitter = replay_jitter * (1 + 0.5 * sqrt(-2 * log(u)) *
+			cos(6.283185307179586 * uniform()));
+		if (jitter < 0) jitter = 0;
+		break;
+	default:
+		jitter = -log(uniform()) * replay_jitter;
+	}
+	return replay_latency + (long)jitter;
+}
@@ -0,0 +1,11 @@
+#define JITTER_EXPONENTIAL 0
+#define JITTER_UNIFORM 1
+#define JITTER_NORMAL 2
+
+void replay_init(const char *record, const char *replay, long latency,
+		long jitter, int distribution);
+int replaying(void);
+void replay_save(const char *url, const char *data, size_t len);
+char *replay_file(const char *file, size_t *len);
+char *replay_load(const char *url, size_t *len);
+long replay_delay(void);
@@ -0,0 +1,216 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include "symbol.h"
+#include "sort.h"
+#include "search.h"
+
+#define SIZEOF(X) (sizeof(X) / sizeof(*X))
+#define QUERY 32 /* longest query */
+#define BIGRAMS 4093 /* hash buckets of the bigram index */
+
+/*
+ * Case insensitive substring filter over tickers and names. Every symbol is
+ * listed under the characters and the hashed character pairs it contains.
+ * The first character of the query picks its list, each following one keeps
+ * the previous matches also listed under the last pair typed. The matches
+ * of every query prefix are kept, so erasing a character costs nothing.
+ */
+struct postings {
+	size_t *ids;
+	size_t length, capacity;
+};
+
+static struct postings chars[256], pairs[BIGRAMS];
+static unsigned int *stamp = NULL, stamp_current = 0;
+
+static char query[QUERY + 1];
+static size_t query_length = 0;
+static struct postings matches[QUERY + 1]; /* matches of each prefix */
+static size_t *rows = NULL;
+
+/* names arrive with the first quote, indexed from the UI thread */
+static pthread_mutex_t search_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t *named = NULL, *pending = NULL, named_length = 0;
+static unsigned char *is_named = NULL;
+
+static int append(struct postings *p, size_t id) {
+
+	size_t *ids;
+
+	if (p->length && p->ids[p->length - 1] == id) return 0;
+	if (p->length == p->capacity) {
+		ids = realloc(p->ids, (p->capacity * 2 + 4) * sizeof(*ids));
+		if (!ids) return -1;
+		p->ids = ids;
+		p->capacity = p->capacity * 2 + 4;
+	}
+	p->ids[p->length++] = id;
+	return 0;
+}
+
+static size_t pair(unsigned char a, unsigned char b) {
+	return (a * 131 + b) % BIGRAMS;
+}
+
+static void index_string(size_t id, const char *s) {
+
+	unsigned char a, b;
+
+	for (a = 0; *s; s++, a = b) {
+		b = tolower((unsigned char)*s);
+		append(&chars[b], id);
+		if (a) append(&pairs[pair(a, b)], id);
+	}
+}
+
+/* whether s contains the first n characters of the query */
+static int contains(const char *s, size_t n) {
+
+	size_t i;
+
+	for (; *s; s++) {
+		for (i = 0; i < n && s[i]; i++)
+			if (tolower((unsigned char)s[i]) != query[i]) break;
+		if (i == n) return 1;
+	}
+	return 0;
+}
+
+int search_init() {
+
+	size_t i;
+
+	stamp = calloc(symbols_length, sizeof(*stamp));
+	rows = malloc(symbols_length * sizeof(*rows));
+	named = malloc(symbols_length * sizeof(*named));
+	pending = malloc(symbols_length * sizeof(*pending));
+	is_named = calloc(symbols_length, 1);
+	if (symbols_length && (!stamp || !rows || !named || !pending ||
+			!is_named))
+		return -1;
+
+	for (i = 0; i < symbols_length; i++)
+		index_string(i, symbols[i].symbol);
+	return 0;
+}
+
+void search_free() {
+
+	size_t i;
+
+	for (i = 0; i < SIZEOF(chars); i++) free(chars[i].ids);
+	for (i = 0; i < SIZEOF(pairs); i++) free(pairs[i].ids);
+	for (i = 0; i < SIZEOF(matches); i++) free(matches[i].ids);
+	free(stamp);
+	free(rows);
+	free(named);
+	free(pending);
+	free(is_named);
+}
+
+/* queue the name of symbol i for indexing, from the fetcher thread */
+void search_mark(size_t i) {
+	pthread_mutex_lock(&search_lock);
+	if (!is_named[i]) {
+		is_named[i] = 1;
+		named[named_length++] = i;
+	}
+	pthread_mutex_unlock(&search_lock);
+}
+
+/* add a character to the query and keep the matches that still apply */
+void search_push(int c) {
+
+	struct postings *from, *to, *list;
+	size_t i, id;
+
+	if (query_length == QUERY || c < ' ' || c > '~') return;
+	query[query_length++] = tolower(c);
+	query[query_length] = '\0';
+	to = &matches[query_length];
+	to->length = 0;
+
+	stamp_current++;
+	if (query_length == 1) {
+		list = &chars[(unsigned char)query[0]];
+		for (i = 0; i < list->length; i++) {
+			id = list->ids[i];
+			if (stamp[id] == stamp_current) continue;
+			stamp[id] = stamp_current;
+			append(to, id);
+		}
+		return;
+	}
+
+	list = &pairs[pair(query[query_length - 2], query[query_length - 1])];
+	for (i = 0; i < list->length; i++) stamp[list->ids[i]] = stamp_current;
+	from = &matches[query_length - 1];
+	for (i = 0; i < from->length; i++) {
+		id = from->ids[i];
+		if (stamp[id] != stamp_current) continue;
+		if (contains(symbols[id].symbol, query_length) ||
+				contains(symbols[id].name, query_length))
+			append(to, id);
+	}
+}
+
+void search_pop() {
+	if (query_length) query[--query_length] = '\0';
+}
+
+void search_clear() {
+	query_length = 0;
+	query[0] = '\0';
+}
+
+const char *search_query() {
+	return query;
+}
+
+static int compare_position(const void *a, const void *b) {
+
+	size_t pa = sort_position(*(const size_t*)a);
+	size_t pb = sort_position(*(const size_t*)b);
+
+	return (pa > pb) - (pa < pb);
+}
+
+/* index the names received and order the matches like the list, UI thread */
+void search_update() {
+
+	size_t i, k, length, id, *swap;
+
+	pthread_mutex_lock(&search_lock);
+	length = named_length;
+	swap = named;
+	named = pending;
+	pending = swap;
+	named_length = 0;
+	pthread_mutex_unlock(&search_lock);
+
+	for (i = 0; i < length; i++) {
+		id = pending[i];
+		index_string(id, symbols[id].name);
+		for (k = 1; k <= query_length; k++)
+			if (!contains(symbols[id].symbol, k) &&
+					contains(symbols[id].name, k))
+				append(&matches[k], id);
+	}
+
+	if (!query_length) return;
+	memcpy(rows, matches[query_length].ids,
+		matches[query_length].length * sizeof(*rows));
+	qsort(rows, matches[query_length].length, sizeof(*rows),
+		compare_position);
+}
+
+/* number of rows shown, every symbol without a query */
+size_t search_length() {
+	return query_length ? matches[query_length].length : symbols_length;
+}
+
+size_t search_row(size_t row) {
+	return query_length ? rows[row] : sort_row(row);
+}
@@ -0,0 +1,10 @@
+int search_init(void);
+void search_free(void);
+void search_mark(size_t i);
+void search_push(int c);
+void search_pop(void);
+void search_clear(void);
+const char *search_query(void);
+void search_update(void);
+size_t search_length(void);
+size_t search_row(size_t row);
@@ -0,0 +1,403 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+#include "strlcpy.h"
+#include "symbol.h"
+#include "server.h"
+#include "config.h"
+
+#define FRAME 36 /* length prefix and quote */
+
+/*
+ * Quotes pushed to the clients of a Unix socket. A client writes one line
+ * per request: a ticker to subscribe to, -ticker to unsubscribe, * and -*
+ * for every symbol. It then receives a frame for the current quote of each
+ * new subscription and for every quote received after that, all integers
+ * and floats big endian:
+ *
+ *   uint32 length of the rest of the frame, 32
+ *   char symbol[16], NUL padded
+ *   float price
+ *   float previous close
+ *   uint32 time of the quote, seconds since the epoch
+ *   uint32 quotes dropped for this client since the previous frame
+ *
+ * Frames wait in a bounded queue per client, new quotes are dropped while
+ * a client is SERVER_QUEUE frames behind.
+ */
+struct client {
+	int fd; /* -1 for a free slot */
+	int all;
+	unsigned char *subscribed; /* by symbol index */
+	char line[32];
+	size_t line_length;
+	unsigned char (*queue)[FRAME];
+	size_t head, tail, sent; /* frames queued, sent, bytes of the next */
+	uint32_t dropped;
+	int writing; /* waiting for the socket to accept more */
+};
+
+static struct client clients[SERVER_CLIENTS];
+static pthread_mutex_t server_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t server_thread;
+static int listen_fd = -1, wake[2] = { -1, -1 }, woken = 0, stopping = 0;
+static char socket_path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+#ifdef __linux__
+static int epoll_fd = -1;
+#endif
+
+static void put32(unsigned char *p, uint32_t value) {
+	value = htonl(value);
+	memcpy(p, &value, 4);
+}
+
+static void put_float(unsigned char *p, float value) {
+
+	uint32_t bits;
+
+	memcpy(&bits, &value, 4);
+	put32(p, bits);
+}
+
+/* queue the quote of symbol i, called with server_lock held */
+static int push(struct client *c, size_t i, uint32_t when) {
+
+	unsigned char *frame;
+
+	if (c->head - c->tail == SERVER_QUEUE) {
+		c->dropped++;
+		return 0;
+	}
+	frame = c->queue[c->head++ % SERVER_QUEUE];
+	put32(frame, FRAME - 4);
+	memset(frame + 4, 0, 16);
+	strncpy((char*)frame + 4, symbols[i].symbol, 16);
+	put_float(frame + 20, symbols[i].price);
+	put_float(frame + 24, symbols[i].previous_price);
+	put32(frame + 28, when);
+	put32(frame + 32, c->dropped);
+	c->dropped = 0;
+	return 1;
+}
+
+/* push the quote of symbol i to its subscribers, from the fetcher thread */
+void server_publish(size_t i, uint32_t time) {
+
+	struct client *c;
+	int queued = 0;
+	char byte = 0;
+
+	if (listen_fd == -1) return;
+	pthread_mutex_lock(&server_lock);
+	for (c = clients; c < clients + SERVER_CLIENTS; c++)
+		if (c->fd != -1 && (c->all || c->subscribed[i]))
+			queued |= push(c, i, time);
+	if (queued && !woken) {
+		woken = 1;
+		write(wake[1], &byte, 1);
+	}
+	pthread_mutex_unlock(&server_lock);
+}
+
+static void watch(int fd, int out, int add) {
+#ifdef __linux__
+	struct epoll_event ev;
+
+	ev.events = EPOLLIN | (out ? EPOLLOUT : 0);
+	ev.data.fd = fd;
+	epoll_ctl(epoll_fd, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &ev);
+#else
+	(void)fd;
+	(void)out;
+	(void)add;
+#endif
+}
+
+static void drop(struct client *c) {
+	pthread_mutex_lock(&server_lock);
+	close(c->fd); /* also removes it from the epoll set */
+	c->fd = -1;
+	pthread_mutex_unlock(&server_lock);
+}
+
+/* write queued frames until the socket is full, with server_lock held */
+static int flush(struct client *c) {
+
+	ssize_t ret;
+
+	while (c->tail != c->head) {
+		ret = send(c->fd, c->queue[c->tail % SERVER_QUEUE] + c->sent,
+			FRAME - c->sent, 0);
+		if (ret == -1 && errno == EINTR) continue;
+		if (ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		if (ret <= 0) return -1;
+		c->sent += ret;
+		if (c->sent == FRAME) {
+			c->sent = 0;
+			c->tail++;
+		}
+	}
+	if (c->writing != (c->tail != c->head)) {
+		c->writing = !c->writing;
+		watch(c->fd, c->writing, 0);
+	}
+	return 0;
+}
+
+static void subscribe(struct client *c, const char *line) {
+
+	int remove = (*line == '-');
+	long i;
+
+	if (remove) line++;
+	if (!strcmp(line, "*")) {
+		c->all = !remove;
+		if (remove) memset(c->subscribed, 0, symbols_length);
+		for (i = 0; !remove && i < (long)symbols_length; i++)
+			if (symbols[i].received) push(c, i, symbols[i].received_time);
+		return;
+	}
+	i = symbol_find(line);
+	if (i == -1) return;
+	c->subscribed[i] = !remove;
+	if (!remove && symbols[i].received) push(c, i, symbols[i].received_time);
+}
+
+/* read subscription lines, -1 once the client is gone */
+static int receive(struct client *c) {
+
+	char buf[512];
+	ssize_t len, k;
+
+	len = read(c->fd, buf, sizeof(buf));
+	if (len == -1 && (errno == EAGAIN || errno == EINTR)) return 0;
+	if (len <= 0) return -1;
+
+	pthread_mutex_lock(&server_lock);
+	for (k = 0; k < len; k++) {
+		if (buf[k] == '\n' || buf[k] == '\r') {
+			c->line[c->line_length] = '\0';
+			if (c->line_length) subscribe(c, c->line);
+			c->line_length = 0;
+		} else if (c->line_length < sizeof(c->line) - 1) {
+			c->line[c->line_length++] = buf[k];
+		}
+	}
+	len = flush(c);
+	pthread_mutex_unlock(&server_lock);
+	return len;
+}
+
+static void accept_client() {
+
+	struct client *c;
+	int fd;
+
+	fd = accept(listen_fd, NULL, NULL);
+	if (fd == -1) return;
+	for (c = clients; c < clients + SERVER_CLIENTS; c++)
+		if (c->fd == -1) break;
+	if (c == clients + SERVER_CLIENTS) {
+		close(fd);
+		return;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+	pthread_mutex_lock(&server_lock);
+	memset(c->subscribed, 0, symbols_length);
+	c->all = 0;
+	c->line_length = 0;
+	c->head = c->tail = c->sent = 0;
+	c->dropped = 0;
+	c->writing = 0;
+	c->fd = fd;
+	pthread_mutex_unlock(&server_lock);
+	watch(fd, 0, 1);
+}
+
+/* handle the events of fd, 0 once stopping */
+static int handle(int fd, int in, int out) {
+
+	struct client *c;
+	char buf[64];
+	int ret = 0;
+
+	if (fd == listen_fd) {
+		accept_client();
+		return 1;
+	}
+	if (fd == wake[0]) {
+		pthread_mutex_lock(&server_lock);
+		while (read(wake[0], buf, sizeof(buf)) > 0) ;
+		woken = 0;
+		for (c = clients; c < clients + SERVER_CLIENTS; c++)
+			if (c->fd != -1 && !c->writing && flush(c)) {
+				close(c->fd);
+				c->fd = -1;
+			}
+		ret = !stopping;
+		pthread_mutex_unlock(&server_lock);
+		return ret;
+	}
+
+	for (c = clients; c < clients + SERVER_CLIENTS; c++)
+		if (c->fd == fd) break;
+	if (c == clients + SERVER_CLIENTS) return 1;
+	if (in && receive(c)) ret = -1;
+	if (!ret && out) {
+		pthread_mutex_lock(&server_lock);
+		ret = flush(c);
+		pthread_mutex_unlock(&server_lock);
+	}
+	if (ret) drop(c);
+	return 1;
+}
+
+#ifdef __linux__
+static void *serve(void *ptr) {
+
+	struct epoll_event events[SERVER_CLIENTS + 2];
+	int i, n, go = 1;
+
+	while (go) {
+		n = epoll_wait(epoll_fd, events, SERVER_CLIENTS + 2, -1);
+		for (i = 0; i < n; i++)
+			go &= handle(events[i].data.fd,
+				events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR),
+				events[i].events & EPOLLOUT) != 0;
+	}
+	return ptr;
+}
+#else
+/* poll(2) fallback, the set is rebuilt on every wakeup */
+static void *serve(void *ptr) {
+
+	struct pollfd fds[SERVER_CLIENTS + 2];
+	struct client *c;
+	int i, n, go = 1;
+
+	while (go) {
+		n = 0;
+		fds[n].fd = listen_fd;
+		fds[n++].events = POLLIN;
+		fds[n].fd = wake[0];
+		fds[n++].events = POLLIN;
+		pthread_mutex_lock(&server_lock);
+		for (c = clients; c < clients + SERVER_CLIENTS; c++) {
+			if (c->fd == -1) continue;
+			fds[n].fd = c->fd;
+			fds[n++].events = POLLIN | (c->writing ? POLLOUT : 0);
+		}
+		pthread_mutex_unlock(&server_lock);
+
+		if (poll(fds, n, -1) <= 0) continue;
+		for (i = 0; i < n; i++)
+			if (fds[i].revents)
+				go &= handle(fds[i].fd, fds[i].revents &
+					(POLLIN | POLLHUP | POLLERR),
+					fds[i].revents & POLLOUT) != 0;
+	}
+	return ptr;
+}
+#endif
+
+/* remove the socket left at path by a previous run, never anything else */
+static int remove_socket(const char *path) {
+
+	struct stat st;
+
+	if (lstat(path, &st)) return errno == ENOENT ? 0 : -1;
+	if (!S_ISSOCK(st.st_mode)) {
+		errno = EEXIST;
+		return -1;
+	}
+	return unlink(path);
+}
+
+/* listen on the Unix socket at path, -1 on error */
+int server_start(const char *path) {
+
+	struct sockaddr_un addr;
+	struct client *c;
+
+	for (c = clients; c < clients + SERVER_CLIENTS; c++) {
+		c->fd = -1;
+		c->subscribed = calloc(symbols_length, 1);
+		c->queue = malloc(SERVER_QUEUE * sizeof(*c->queue));
+		if ((symbols_length && !c->subscribed) || !c->queue)
+			return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlcpy(addr.sun_path, path, sizeof(addr.sun_path)) >=
+			sizeof(addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	if (remove_socket(path)) return -1;
+	strlcpy(socket_path, path, sizeof(socket_path));
+	/* a client gone mid frame fails send() with EPIPE instead */
+	signal(SIGPIPE, SIG_IGN);
+
+	listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listen_fd == -1) return -1;
+	if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) ||
+			listen(listen_fd, SERVER_CLIENTS) || pipe(wake)) {
+		close(listen_fd);
+		listen_fd = -1;
+		return -1;
+	}
+	fcntl(wake[0], F_SETFL, fcntl(wake[0], F_GETFL) | O_NONBLOCK);
+
+#ifdef __linux__
+	epoll_fd = epoll_create(SERVER_CLIENTS + 2);
+	if (epoll_fd == -1) return -1;
+	watch(listen_fd, 0, 1);
+	watch(wake[0], 0, 1);
+#endif
+	return pthread_create(&server_thread, NULL, serve, NULL) ? -1 : 0;
+}
+
+void server_stop() {
+
+	struct client *c;
+	char byte = 0;
+
+	if (listen_fd == -1) return;
+	pthread_mutex_lock(&server_lock);
+	stopping = 1;
+	write(wake[1], &byte, 1);
+	pthread_mutex_unlock(&server_lock);
+	pthread_join(server_thread, NULL);
+
+	for (c = clients; c < clients + SERVER_CLIENTS; c++) {
+		if (c->fd != -1) close(c->fd);
+		free(c->subscribed);
+		free(c->queue);
+	}
+	close(listen_fd);
+	close(wake[0]);
+	close(wake[1]);
+#ifdef __linux__
+	close(epoll_fd);
+#endif
+	remove_socket(socket_path);
+	symbol_find_free();
+	listen_fd = -1;
+}
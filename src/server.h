@@ -0,0 +1,3 @@
+int server_start(const char *path);
+void server_stop(void);
+void server_publish(size_t i, uint32_t time);
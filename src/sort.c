@@ -0,0 +1,158 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "symbol.h"
+#include "sort.h"
+
+/*
+ * Display order of the symbols. Rows are sorted on a snapshot of their key
+ * taken when they were last placed, so the order stays consistent while
+ * the fetcher updates prices, and updated rows are moved one at a time.
+ */
+int sort_column = SORT_NONE, sort_reverse = 0;
+static size_t *order = NULL, *position = NULL;
+static float *keys = NULL;
+
+/* rows updated since the last sort_update(), filled by the fetcher */
+static pthread_mutex_t sort_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t *dirty = NULL, *pending = NULL, dirty_length = 0;
+static unsigned char *is_dirty = NULL;
+
+static float key(size_t i) {
+
+	const struct symbol *s = &symbols[i];
+
+	switch (sort_column) {
+	case SORT_PRICE:
+		return s->price;
+	case SORT_CHANGE:
+		return s->price - s->previous_price;
+	case SORT_PERCENT:
+		return s->previous_price ?
+			s->price / s->previous_price * 100 - 100 : 0;
+	}
+	return 0;
+}
+
+/* numbers sort highest first, symbols in alphabetical order */
+static int compare(size_t a, size_t b) {
+
+	int ret;
+
+	if (sort_column == SORT_NONE) ret = 0;
+	else if (sort_column == SORT_SYMBOL)
+		ret = strcmp(symbols[a].symbol, symbols[b].symbol);
+	else ret = (keys[a] < keys[b]) - (keys[a] > keys[b]);
+
+	if (sort_reverse) ret = -ret;
+	if (!ret) ret = (a > b) - (a < b);
+	return ret;
+}
+
+static int compare_qsort(const void *a, const void *b) {
+	return compare(*(const size_t*)a, *(const size_t*)b);
+}
+
+int sort_init() {
+
+	size_t i;
+
+	order = malloc(symbols_length * sizeof(*order));
+	position = malloc(symbols_length * sizeof(*position));
+	keys = malloc(symbols_length * sizeof(*keys));
+	dirty = malloc(symbols_length * sizeof(*dirty));
+	pending = malloc(symbols_length * sizeof(*pending));
+	is_dirty = calloc(symbols_length, 1);
+	if (symbols_length && (!order || !position || !keys || !dirty ||
+			!pending || !is_dirty))
+		return -1;
+
+	for (i = 0; i < symbols_length; i++) {
+		order[i] = position[i] = i;
+		keys[i] = 0;
+	}
+	return 0;
+}
+
+void sort_free() {
+	free(order);
+	free(position);
+	free(keys);
+	free(dirty);
+	free(pending);
+	free(is_dirty);
+}
+
+/* sort every row by column, from the UI thread */
+void sort_set(int column, int reverse) {
+
+	size_t i;
+
+	sort_column = column;
+	sort_reverse = reverse;
+	for (i = 0; i < symbols_length; i++) keys[i] = key(i);
+	qsort(order, symbols_length, sizeof(*order), compare_qsort);
+	for (i = 0; i < symbols_length; i++) position[order[i]] = i;
+}
+
+/* flag the row of symbol i as updated, from the fetcher thread */
+void sort_mark(size_t i) {
+	pthread_mutex_lock(&sort_lock);
+	if (!is_dirty[i]) {
+		is_dirty[i] = 1;
+		dirty[dirty_length++] = i;
+	}
+	pthread_mutex_unlock(&sort_lock);
+}
+
+/* move row i to its place with a binary search over the other rows */
+static void reinsert(size_t i) {
+
+	size_t from, to, low, high, mid, k;
+
+	from = position[i];
+	memmove(order + from, order + from + 1,
+		(symbols_length - from - 1) * sizeof(*order));
+	keys[i] = key(i);
+
+	low = 0;
+	high = symbols_length - 1;
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (compare(order[mid], i) < 0) low = mid + 1;
+		else high = mid;
+	}
+	to = low;
+	memmove(order + to + 1, order + to,
+		(symbols_length - to - 1) * sizeof(*order));
+	order[to] = i;
+
+	for (k = from < to ? from : to; k <= (from < to ? to : from); k++)
+		position[order[k]] = k;
+}
+
+/* move the rows updated since the last call, from the UI thread */
+void sort_update() {
+
+	size_t i, length, *swap;
+
+	pthread_mutex_lock(&sort_lock);
+	length = dirty_length;
+	swap = dirty;
+	dirty = pending;
+	pending = swap;
+	dirty_length = 0;
+	for (i = 0; i < length; i++) is_dirty[pending[i]] = 0;
+	pthread_mutex_unlock(&sort_lock);
+
+	if (sort_column == SORT_NONE || sort_column == SORT_SYMBOL) return;
+	for (i = 0; i < length; i++) reinsert(pending[i]);
+}
+
+size_t sort_row(size_t row) {
+	return order[row];
+}
+
+size_t sort_position(size_t i) {
+	return position[i];
+}
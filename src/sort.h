@@ -0,0 +1,14 @@
+#define SORT_NONE 0
+#define SORT_SYMBOL 1
+#define SORT_PRICE 2
+#define SORT_CHANGE 3
+#define SORT_PERCENT 4
+#define SORTS 5
+extern int sort_column, sort_reverse;
+int sort_init(void);
+void sort_free(void);
+void sort_set(int column, int reverse);
+void sort_mark(size_t i);
+void sort_update(void);
+size_t sort_row(size_t row);
+size_t sort_position(size_t i);
@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "stats.h"
+
+#ifdef __GNUC__
+#define atomic_add(p, n) __sync_fetch_and_add(p, n)
+#else
+#define atomic_add(p, n) (*(p) += (n))
+#endif
+
+#define LATENCY_SAMPLES 1024
+#define BUCKETS 32 /* of the phase histograms, by powers of two */
+
+/* last values of a measure, oldest overwritten first */
+struct samples {
+	long values[LATENCY_SAMPLES];
+	size_t count;
+};
+
+/* fetch latencies in milliseconds, quote ages in seconds */
+static pthread_mutex_t latency_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct samples latencies, ages;
+
+/* transfers made and connections they opened */
+static long transfers = 0, connections = 0;
+
+/*
+ * Counters read by the performance overlay, updated with atomic_add since
+ * several threads may add to one. Aligned longs are read whole.
+ */
+static volatile long counts[COUNTS];
+
+/* durations of the phases of a fetch, bucket b counts [2^b, 2^(b+1)) us */
+static long phases[PHASES][BUCKETS];
+static const char *phase_names[PHASES] = {
+	"dns", "connect", "tls", "transfer", "parse"
+};
+
+long now_ms() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+long now_us() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* CPU time used by the calling thread */
+long cpu_us() {
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void add(struct samples *s, long value) {
+	pthread_mutex_lock(&latency_lock);
+	s->values[s->count++ % LATENCY_SAMPLES] = value;
+	pthread_mutex_unlock(&latency_lock);
+}
+
+static int cmp_long(const void *a, const void *b) {
+	long x = *(const long*)a, y = *(const long*)b;
+	return (x > y) - (x < y);
+}
+
+/* p50, p95 and p99 of the samples from one sort, -1 without samples */
+static int percentiles(struct samples *s, long *p) {
+
+	static const int ranks[PERCENTILES] = { 50, 95, 99 };
+	long sorted[LATENCY_SAMPLES];
+	size_t len;
+	int i;
+
+	pthread_mutex_lock(&latency_lock);
+	len = s->count < LATENCY_SAMPLES ? s->count : LATENCY_SAMPLES;
+	memcpy(sorted, s->values, len * sizeof(*sorted));
+	pthread_mutex_unlock(&latency_lock);
+
+	if (!len) return -1;
+	qsort(sorted, len, sizeof(*sorted), cmp_long);
+	for (i = 0; i < PERCENTILES; i++)
+		p[i] = sorted[(len - 1) * ranks[i] / 100];
+	return 0;
+}
+
+void stats_latency(long ms) {
+	add(&latencies, ms);
+}
+
+size_t stats_samples() {
+
+	size_t ret;
+
+	pthread_mutex_lock(&latency_lock);
+	ret = latencies.count;
+	pthread_mutex_unlock(&latency_lock);
+	return ret < LATENCY_SAMPLES ? ret : LATENCY_SAMPLES;
+}
+
+int stats_percentiles(long *p) {
+	return percentiles(&latencies, p);
+}
+
+/* age of a quote when received, from its exchange time */
+void stats_age(long seconds) {
+	add(&ages, seconds);
+}
+
+int stats_age_percentiles(long *p) {
+	return percentiles(&ages, p);
+}
+
+void stats_transfer(long connects) {
+	pthread_mutex_lock(&latency_lock);
+	transfers++;
+	connections += connects;
+	pthread_mutex_unlock(&latency_lock);
+}
+
+/* average number of transfers carried by a connection */
+double stats_streams() {
+
+	double ret;
+
+	pthread_mutex_lock(&latency_lock);
+	ret = connections ? (double)transfers / connections : transfers;
+	pthread_mutex_unlock(&latency_lock);
+	return ret;
+}
+
+void stats_count(int counter, long n) {
+	atomic_add(&counts[counter], n);
+}
+
+long stats_counter(int counter) {
+	return counts[counter];
+}
+
+/* fraction of the transfers that reused a connection */
+double stats_reuse() {
+
+	double ret;
+
+	pthread_mutex_lock(&latency_lock);
+	ret = transfers ? 1 - (double)connections / transfers : 0;
+	pthread_mutex_unlock(&latency_lock);
+	return ret < 0 ? 0 : ret;
+}
+
+void stats_phase(int phase, long us) {
+
+	int b = 0;
+
+	while (us > 1 && b < BUCKETS - 1) {
+		us >>= 1;
+		b++;
+	}
+	pthread_mutex_lock(&latency_lock);
+	phases[phase][b]++;
+	pthread_mutex_unlock(&latency_lock);
+}
+
+/* print a histogram of each phase measured, one line per bucket used */
+void stats_histograms() {
+
+	long total, width;
+	int p, b, first, last;
+
+	pthread_mutex_lock(&latency_lock);
+	for (p = 0; p < PHASES; p++) {
+		total = 0;
+		first = BUCKETS;
+		last = 0;
+		for (b = 0; b < BUCKETS; b++) {
+			total += phases[p][b];
+			if (phases[p][b] && b < first) first = b;
+			if (phases[p][b]) last = b;
+		}
+		if (!total) continue;
+		printf("%s, %ld samples\n", phase_names[p], total);
+		for (b = first; b <= last; b++) {
+			width = phases[p][b] * 40 / total;
+			printf("  < %8ld us %8ld ", 2L << b, phases[p][b]);
+			while (width--) putchar('#');
+			putchar('\n');
+		}
+	}
+	pthread_mutex_unlock(&latency_lock);
+}
@@ -0,0 +1,29 @@
+#define PHASE_DNS 0
+#define PHASE_CONNECT 1
+#define PHASE_TLS 2
+#define PHASE_TRANSFER 3
+#define PHASE_PARSE 4
+#define PHASES 5
+
+#define COUNT_QUOTES 0
+#define COUNT_RECEIVED 1 /* bytes of response bodies */
+#define COUNT_PENDING 2 /* requests in flight */
+#define COUNTS 3
+
+#define PERCENTILES 3 /* p50, p95, p99 */
+
+long now_ms(void);
+long now_us(void);
+long cpu_us(void);
+void stats_latency(long ms);
+int stats_percentiles(long *p);
+size_t stats_samples(void);
+void stats_age(long seconds);
+int stats_age_percentiles(long *p);
+void stats_transfer(long connects);
+double stats_streams(void);
+void stats_count(int counter, long n);
+long stats_counter(int counter);
+double stats_reuse(void);
+void stats_phase(int phase, long us);
+void stats_histograms(void);
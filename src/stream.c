@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include "symbol.h"
+#include "stats.h"
+#include "stream.h"
+#include "config.h"
+
+#define STREAM_BUFFER (64 << 10) /* bytes written at once */
+
+/* quotes written by --headless, only used from the fetcher thread */
+static FILE *stream = NULL;
+static int stream_format = STREAM_JSON;
+static long stream_synced = 0;
+static char stream_buffer[STREAM_BUFFER];
+
+/* open the output, stdout without a path, -1 on error */
+int stream_open(const char *path, int format) {
+
+	stream = path ? fopen(path, "w") : stdout;
+	if (!stream) return -1;
+	setvbuf(stream, stream_buffer, _IOFBF, sizeof(stream_buffer));
+	stream_format = format;
+	if (format == STREAM_CSV)
+		fputs("time,symbol,price,previous_close,name\n", stream);
+	stream_synced = now_ms();
+	return 0;
+}
+
+void stream_close() {
+	if (!stream) return;
+	if (stream == stdout) fflush(stream);
+	else fclose(stream);
+	stream = NULL;
+}
+
+/* names are copied raw from the JSON quote, still escaped */
+static void put_json(const char *s) {
+
+	size_t len = strlen(s), slashes = 0;
+
+	while (slashes < len && s[len - slashes - 1] == '\\') slashes++;
+	if (slashes % 2) len--; /* cut in the middle of an escape */
+	for (; len; s++, len--) {
+		if ((unsigned char)*s < ' ') fprintf(stream, "\\u%04x", *s);
+		else putc(*s, stream);
+	}
+}
+
+/* tickers come from the symbols file, raw */
+static void put_json_raw(const char *s) {
+	for (; *s; s++) {
+		if ((unsigned char)*s < ' ') fprintf(stream, "\\u%04x", *s);
+		else {
+			if (*s == '"' || *s == '\\') putc('\\', stream);
+			putc(*s, stream);
+		}
+	}
+}
+
+static int hex4(const char *s, unsigned long *c) {
+
+	int i;
+
+	*c = 0;
+	for (i = 0; i < 4; i++, s++) {
+		*c <<= 4;
+		if (*s >= '0' && *s <= '9') *c |= *s - '0';
+		else if (*s >= 'a' && *s <= 'f') *c |= *s - 'a' + 10;
+		else if (*s >= 'A' && *s <= 'F') *c |= *s - 'A' + 10;
+		else return -1;
+	}
+	return 0;
+}
+
+static void put_utf8(unsigned long c) {
+	if (c < 0x80) putc(c, stream);
+	else if (c < 0x800) {
+		putc(0xc0 | c >> 6, stream);
+		putc(0x80 | (c & 0x3f), stream);
+	} else if (c < 0x10000) {
+		putc(0xe0 | c >> 12, stream);
+		putc(0x80 | (c >> 6 & 0x3f), stream);
+		putc(0x80 | (c & 0x3f), stream);
+	} else {
+		putc(0xf0 | c >> 18, stream);
+		putc(0x80 | (c >> 12 & 0x3f), stream);
+		putc(0x80 | (c >> 6 & 0x3f), stream);
+		putc(0x80 | (c & 0x3f), stream);
+	}
+}
+
+/*
+ * Decode the JSON escape at s, just after its backslash, into a code
+ * point. Returns the length of the escape, 0 if it is invalid.
+ */
+static size_t unescape(const char *s, unsigned long *c) {
+
+	unsigned long low;
+
+	switch (*s) {
+	case 'b': *c = '\b'; return 1;
+	case 'f': *c = '\f'; return 1;
+	case 'n': *c = '\n'; return 1;
+	case 'r': *c = '\r'; return 1;
+	case 't': *c = '\t'; return 1;
+	case '"': case '\\': case '/': *c = *s; return 1;
+	case 'u':
+		if (hex4(s + 1, c)) return 0;
+		if (*c < 0xd800 || *c > 0xdfff) return 5;
+		/* a surrogate pair, a lone surrogate is replaced */
+		if (*c < 0xdc00 && s[5] == '\\' && s[6] == 'u' &&
+				!hex4(s + 7, &low) && low >= 0xdc00 &&
+				low <= 0xdfff) {
+			*c = 0x10000 + ((*c - 0xd800) << 10) + (low - 0xdc00);
+			return 11;
+		}
+		*c = 0xfffd;
+		return 5;
+	}
+	return 0;
+}
+
+/* a quoted field, names are decoded from JSON first */
+static void put_csv(const char *s, int escaped) {
+
+	unsigned long c;
+	size_t len;
+
+	putc('"', stream);
+	for (; *s; s++) {
+		if (escaped && *s == '\\' && (len = unescape(s + 1, &c))) {
+			if (c == '"') putc('"', stream);
+			put_utf8(c);
+			s += len;
+			continue;
+		}
+		if (*s == '"') putc('"', stream);
+		putc(*s, stream);
+	}
+	putc('"', stream);
+}
+
+/* write a quote as a JSON line or a CSV row */
+void stream_quote(const struct symbol *s) {
+
+	struct timeval tv;
+
+	if (!stream) return;
+	gettimeofday(&tv, NULL);
+	if (stream_format == STREAM_CSV) {
+		fprintf(stream, "%ld.%03ld,", (long)tv.tv_sec,
+			(long)tv.tv_usec / 1000);
+		put_csv(s->symbol, 0);
+		fprintf(stream, ",%.9g,%.9g,", s->price, s->previous_price);
+		put_csv(s->name, 1);
+		putc('\n', stream);
+		return;
+	}
+	fprintf(stream, "{\"time\":%ld.%03ld,\"symbol\":\"", (long)tv.tv_sec,
+		(long)tv.tv_usec / 1000);
+	put_json_raw(s->symbol);
+	fprintf(stream, "\",\"price\":%.9g,\"previous_close\":%.9g,"
+		"\"name\":\"", s->price, s->previous_price);
+	put_json(s->name);
+	fputs("\"}\n", stream);
+}
+
+/* flush the output every STREAM_SYNC milliseconds, or now if forced */
+void stream_sync(int force) {
+
+	long now;
+
+	if (!stream) return;
+	now = now_ms();
+	if (!force && now - stream_synced < STREAM_SYNC) return;
+	fflush(stream);
+	stream_synced = now;
+}
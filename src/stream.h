@@ -0,0 +1,7 @@
+#define STREAM_JSON 0
+#define STREAM_CSV 1
+struct symbol;
+int stream_open(const char *path, int format);
+void stream_close(void);
+void stream_quote(const struct symbol *s);
+void stream_sync(int force);
@@ -0,0 +1,40 @@
+#include <stdlib.h>
+#include <string.h>
+#include "symbol.h"
+
+/* symbol indices sorted by ticker, built on the first lookup */
+static size_t *by_name = NULL;
+
+static int compare_name(const void *a, const void *b) {
+	return strcmp(symbols[*(const size_t*)a].symbol,
+		symbols[*(const size_t*)b].symbol);
+}
+
+static int compare_key(const void *key, const void *b) {
+	return strcmp(key, symbols[*(const size_t*)b].symbol);
+}
+
+/* index of the first symbol with this ticker, -1 if not watched */
+long symbol_find(const char *name) {
+
+	size_t i, *found;
+
+	if (!by_name) {
+		by_name = malloc(symbols_length * sizeof(*by_name));
+		if (!by_name) return -1;
+		for (i = 0; i < symbols_length; i++) by_name[i] = i;
+		qsort(by_name, symbols_length, sizeof(*by_name), compare_name);
+	}
+
+	found = bsearch(name, by_name, symbols_length, sizeof(*by_name),
+		compare_key);
+	if (!found) return -1;
+	while (found > by_name && !strcmp(symbols[found[-1]].symbol, name))
+		found--;
+	return *found;
+}
+
+void symbol_find_free() {
+	free(by_name);
+	by_name = NULL;
+}
@@ -0,0 +1,22 @@
+#ifndef SYMBOL_H
+#define SYMBOL_H
+
+struct symbol {
+	char symbol[16];
+	char name[256];
+	float price;
+	float previous_price;
+	unsigned int cycle; /* last refresh cycle that requested the symbol */
+	long received; /* now_ms() of the last quote, 0 before the first */
+	unsigned long received_time; /* its wall clock time, in seconds */
+	unsigned long market_time; /* exchange time of the quote, 0 unknown */
+	int regular; /* quoted during the regular session */
+	struct history *history;
+};
+extern struct symbol *symbols;
+extern size_t symbols_length;
+
+long symbol_find(const char *name);
+void symbol_find_free(void);
+
+#endif
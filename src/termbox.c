@@ -163,6 +163,7 @@ struct tb_global_t {
 	struct termios orig_tios;
 	int has_orig_tios;
 	int last_errno;
+	size_t written;
 	int initialized;
 	int (*fn_extract_esc_pre)(struct tb_event *, size_t *);
 	int (*fn_extract_esc_post)(struct tb_event *, size_t *);
@@ -1372,6 +1373,10 @@ int tb_last_errno(void) {
 	return global.last_errno;
 }
 
+size_t tb_written(void) {
+	return global.written;
+}
+
 const char *tb_strerror(int err) {
 	switch (err) {
 		case TB_OK:
@@ -1667,7 +1672,8 @@ static int update_term_size(void) {
 	struct winsize sz;
 
 	if (global.ttyfd < 0) {
-		return TB_OK;
+		/* pipes given to tb_init_rwfd() may answer the escape query */
+		return update_term_size_via_esc();
 	}
 
 	memset(&sz, 0, sizeof(sz));
@@ -2860,6 +2866,7 @@ static int bytebuf_flush(struct bytebuf_t *b, int fd) {
 		global.last_errno = errno;
 		return TB_ERR;
 	}
+	global.written += b->len;
 	b->len = 0;
 	return TB_OK;
 }
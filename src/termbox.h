@@ -539,6 +539,7 @@ int tb_utf8_char_length(char c);
 int tb_utf8_char_to_unicode(uint32_t *out, const char *c);
 int tb_utf8_unicode_to_char(char *out, uint32_t c);
 int tb_last_errno(void);
+size_t tb_written(void); /* bytes sent to the terminal since tb_init() */
 const char *tb_strerror(int err);
 struct tb_cell *tb_cell_buffer(void);
 int tb_has_truecolor(void);
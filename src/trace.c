@@ -0,0 +1,222 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "strlcpy.h"
+#include "stats.h"
+#include "trace.h"
+#include "config.h"
+
+#ifdef TRACE
+
+#ifdef __GNUC__
+#define barrier() __sync_synchronize()
+#else
+#define barrier()
+#endif
+
+#define TRACE_DEPTH 16 /* nested spans of a thread */
+
+/*
+ * Each thread writes its spans to its own ring of TRACE_EVENTS, oldest
+ * overwritten first, published by bumping written. Threads only take
+ * trace_lock the first time they trace, to join the list of rings.
+ */
+struct span {
+	const char *name;
+	long start, end; /* microseconds */
+	unsigned long id; /* of an async span, 0 for a nested one */
+};
+
+struct ring {
+	struct span spans[TRACE_EVENTS];
+	volatile unsigned long written;
+	const char *names[TRACE_DEPTH];
+	long starts[TRACE_DEPTH];
+	int depth;
+	int tid;
+	char thread[16];
+	struct ring *next;
+};
+
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t trace_key;
+static struct ring *rings = NULL;
+static int tracing = 0, threads = 0;
+static char trace_path[1024];
+static volatile sig_atomic_t dump_wanted = 0;
+
+static void on_signal(int sig) {
+	(void)sig;
+	dump_wanted = 1;
+}
+
+/* write the trace to path on exit and when sent SIGUSR1, -1 on error */
+int trace_open(const char *path) {
+
+	struct sigaction sa;
+
+	if (pthread_key_create(&trace_key, NULL)) return -1;
+	strlcpy(trace_path, path, sizeof(trace_path));
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal;
+	sigaction(SIGUSR1, &sa, NULL);
+	tracing = 1;
+	return 0;
+}
+
+static struct ring *ring() {
+
+	struct ring *r;
+
+	r = pthread_getspecific(trace_key);
+	if (r) return r;
+	r = calloc(1, sizeof(*r));
+	if (!r) return NULL;
+	pthread_mutex_lock(&trace_lock);
+	r->tid = ++threads;
+	r->next = rings;
+	rings = r;
+	pthread_mutex_unlock(&trace_lock);
+	pthread_setspecific(trace_key, r);
+	return r;
+}
+
+static void record(struct ring *r, const char *name, long start,
+		unsigned long id) {
+
+	struct span *s;
+
+	s = &r->spans[r->written % TRACE_EVENTS];
+	s->name = name;
+	s->start = start;
+	s->end = now_us();
+	s->id = id;
+	barrier();
+	r->written++;
+}
+
+/* name the calling thread in the trace */
+void trace_thread(const char *name) {
+
+	struct ring *r;
+
+	if (!tracing || !(r = ring())) return;
+	strlcpy(r->thread, name, sizeof(r->thread));
+}
+
+/* open a span of the calling thread, closed by trace_end() */
+void trace_begin(const char *name) {
+
+	struct ring *r;
+
+	if (!tracing || !(r = ring())) return;
+	if (r->depth < TRACE_DEPTH) {
+		r->names[r->depth] = name;
+		r->starts[r->depth] = now_us();
+	}
+	r->depth++;
+}
+
+void trace_end() {
+
+	struct ring *r;
+
+	if (!tracing || !(r = pthread_getspecific(trace_key)) || !r->depth)
+		return;
+	r->depth--;
+	if (r->depth < TRACE_DEPTH)
+		record(r, r->names[r->depth], r->starts[r->depth], 0);
+}
+
+/* a span from start to now overlapping others, like a request */
+void trace_async(const char *name, unsigned long id, long start) {
+
+	struct ring *r;
+
+	if (!tracing || !(r = ring())) return;
+	record(r, name, start, id);
+}
+
+static void dump() {
+
+	const struct span *s;
+	struct ring *r;
+	unsigned long i, written;
+	long pid = getpid();
+	FILE *f;
+	int first = 1;
+
+	f = fopen(trace_path, "w");
+	if (!f) return;
+	fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", f);
+	pthread_mutex_lock(&trace_lock);
+	for (r = rings; r; r = r->next) {
+		fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%ld,"
+			"\"tid\":%d,\"args\":{\"name\":\"%s\"}}", first ? "" : ",\n",
+			pid, r->tid, *r->thread ? r->thread : "thread");
+		first = 0;
+
+		/* spans near the end of the ring may be overwritten meanwhile */
+		written = r->written;
+		barrier();
+		i = written > TRACE_EVENTS ? written - TRACE_EVENTS + 64 : 0;
+		for (; i < written; i++) {
+			s = &r->spans[i % TRACE_EVENTS];
+			if (!s->id) {
+				fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%ld,"
+					"\"tid\":%d,\"ts\":%ld,\"dur\":%ld}", s->name, pid,
+					r->tid, s->start, s->end - s->start);
+				continue;
+			}
+			fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"b\","
+				"\"id\":%lu,\"pid\":%ld,\"tid\":%d,\"ts\":%ld}", s->name,
+				s->name, s->id, pid, r->tid, s->start);
+			fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"e\","
+				"\"id\":%lu,\"pid\":%ld,\"tid\":%d,\"ts\":%ld}", s->name,
+				s->name, s->id, pid, r->tid, s->end);
+		}
+	}
+	pthread_mutex_unlock(&trace_lock);
+	fputs("\n]}\n", f);
+	fclose(f);
+}
+
+/* write the trace if SIGUSR1 asked for it, from the fetcher loop */
+void trace_poll() {
+	if (!dump_wanted) return;
+	dump_wanted = 0;
+	dump();
+}
+
+/* write the trace, once the other threads are done */
+void trace_close() {
+
+	struct ring *r;
+
+	if (!tracing) return;
+	dump();
+	while (rings) {
+		r = rings;
+		rings = r->next;
+		free(r);
+	}
+	pthread_key_delete(trace_key);
+	tracing = 0;
+}
+
+#else
+
+int trace_open(const char *path) {
+	(void)path;
+	errno = ENOSYS; /* built without -DTRACE */
+	return -1;
+}
+
+void trace_close() {
+}
+
+#endif
@@ -0,0 +1,20 @@
+/*
+ * Spans of the fetch, parse, publish and frame paths, written as Chrome
+ * trace events by --trace. Built with -DTRACE only, the span calls are
+ * removed otherwise.
+ */
+int trace_open(const char *path);
+void trace_close(void);
+#ifdef TRACE
+void trace_thread(const char *name);
+void trace_begin(const char *name);
+void trace_end(void);
+void trace_async(const char *name, unsigned long id, long start);
+void trace_poll(void);
+#else
+#define trace_thread(name)
+#define trace_begin(name)
+#define trace_end()
+#define trace_async(name, id, start)
+#define trace_poll()
+#endif